@@ -0,0 +1,98 @@
+/*
+ * Allocation tracking, see alloc_track.h
+ * The C hooks forward to glibc's own entry points, so they work before anything else is initialized.
+ */
+
+#include "alloc_track.h"
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+static std::atomic<bool> tracking(false);
+static std::atomic<long> allocations(0);
+
+void alloc_track(bool on) {
+    tracking = on;
+}
+
+long alloc_count() {
+    return allocations.load();
+}
+
+#ifndef ALLOC_CHECK
+
+bool alloc_hooked() {
+    return false;
+}
+
+#else
+
+bool alloc_hooked() {
+    return true;
+}
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *p, size_t size);
+void __libc_free(void *p);
+}
+
+static inline void count() {
+    if (tracking.load(std::memory_order_relaxed)) allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+extern "C" void *malloc(size_t size) {
+    count();
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size) {
+    count();
+    return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *p, size_t size) {
+    count();
+    return __libc_realloc(p, size);
+}
+
+extern "C" void free(void *p) {
+    __libc_free(p);
+}
+
+void *operator new(size_t size) {
+    void *p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return malloc(size ? size : 1);
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    free(p);
+}
+
+#endif // ALLOC_CHECK
@@ -0,0 +1,22 @@
+/*
+ * Allocation tracking for the --alloc-check benchmark
+ * In a build with -DALLOC_CHECK, malloc, calloc, realloc and every operator new are hooked for the whole process (all
+ * threads, libraries included) and counted while tracking is on. When it is off, a hook costs one relaxed atomic load.
+ * Other builds keep the allocator of the C library untouched, and cannot count.
+ */
+
+#ifndef ALLOC_TRACK_H
+#define ALLOC_TRACK_H
+
+#define ALLOC_WARMUP 3 // Generations allowed to allocate (lazy buffers, stdio) before the steady state is checked
+
+// Turns counting on or off
+void alloc_track(bool on);
+
+// Allocations counted so far
+long alloc_count();
+
+// Whether this build hooks the allocator (-DALLOC_CHECK)
+bool alloc_hooked();
+
+#endif // ALLOC_TRACK_H
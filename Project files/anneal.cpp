@@ -0,0 +1,174 @@
+/*
+ * Parallel tempering ensemble, see anneal.h
+ */
+
+#include "anneal.h"
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+// One annealing chain and its private buffers
+struct Chain {
+    std::thread thread;
+    Chromosome *state;          // state, best and scratch are allocated by the chain, on its node
+    unsigned char *scratch;
+    std::atomic<ll> energy{0};  // fitness of state, published for replica exchange
+    std::atomic<int> temp{0};   // index into the temperature ladder, the only thing chains exchange
+    std::atomic<long> steps{0};
+
+    std::mutex m;               // guards best
+    Chromosome *best;           // best state visited by this chain, genome only (its window is not kept up to date)
+};
+
+static Chain *chains = nullptr;
+static int n_chains = 0;
+static double *ladder = nullptr; // temperature of every index, geometric from ANNEAL_T_MIN to ANNEAL_T_MAX
+static int *holder = nullptr;    // which chain holds every temperature index, rebuilt by every exchange sweep
+static std::atomic<bool> running(false);
+static unsigned int exchange_seed = 0;
+static std::atomic<int> ready(0); // chains done with their setup
+
+// A move of a chain: one coordinate of a corner of triangle t (of a shared vertex with a mesh genome), or one of its
+// scored color channels
+struct Move {
+    int t, v, axis; // v is -1 for a color move, axis is then the channel
+    double old;
+};
+
+// Applies a random move to triangle t, returns what undo() needs along with the pixels it re-renders
+static Move mutate_one(Chromosome &c, int t, Rect &r, unsigned int &seed) {
+    Move m = {t, -1, 0, 0};
+    if (U_RND < 0.7) {
+        m.v = rand_r(&seed) % V;
+        m.axis = rand_r(&seed) % 2;
+        if (params.mesh) m.v = c.index[t][m.v];
+        m.old = params.mesh ? c.vertex[m.v][m.axis] : c.point[t][m.v][m.axis];
+        r = c.corner_rect(t, m.v);
+        c.set_coordinate(t, m.v, m.axis, std::min(1.0, std::max(0.0, m.old + RND * 0.05)));
+        r = rect_union(r, c.corner_rect(t, m.v));
+    } else {
+        m.axis = Chromosome::random_channel(seed);
+        m.old = c.color[t][m.axis];
+        c.color[t][m.axis] = std::min(1.0, std::max(0.0, m.old + RND * 0.1));
+        r = c.tri_rect(t);
+    }
+    return m;
+}
+
+static void undo(Chromosome &c, const Move &m) {
+    if (m.v < 0) c.color[m.t][m.axis] = m.old;
+    else c.set_coordinate(m.t, m.v, m.axis, m.old);
+}
+
+static void chain_run(Chain *ch, int worker, const Chromosome *init, unsigned int seed) {
+    numa_pin(worker);
+    size_t bytes = sizeof(unsigned char) * input.width * input.height * channels;
+    ch->scratch = (unsigned char *) numa_alloc(bytes);
+    memset(ch->scratch, 0, bytes);
+    ch->state = numa_chromosome(init);
+    {
+        std::lock_guard<std::mutex> lock(ch->m);
+        ch->best = numa_chromosome(init);
+    }
+    ch->energy = ch->state->fit_val;
+    ready++;
+
+    Chromosome &c = *ch->state;
+    ll best_fit = c.fit_val;
+
+    for (long step = 0; running.load(std::memory_order_relaxed); step++) {
+        Rect r;
+        Move m = mutate_one(c, rand_r(&seed) % params.triangles, r, seed);
+        if (m.v >= 0) c.reindex_corner(m.t, m.v);
+
+        // Metropolis criterion at whatever temperature this chain currently holds
+        ll d = c.rescore(r, ch->scratch);
+        double temp = ladder[ch->temp.load(std::memory_order_relaxed)];
+        if (d <= 0 || U_RND < exp(-d / temp)) {
+            c.commit(r, ch->scratch, d);
+            ch->energy.store(c.fit_val, std::memory_order_relaxed);
+        } else {
+            undo(c, m);
+            if (m.v >= 0) c.reindex_corner(m.t, m.v);
+        }
+        ch->steps.store(step + 1, std::memory_order_relaxed);
+
+        // Every new best is kept, the genome is cheap to copy next to the window
+        if (c.fit_val < best_fit) {
+            std::lock_guard<std::mutex> lock(ch->m);
+            ch->best->copy_genome(c);
+            best_fit = c.fit_val;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(ch->m);
+    numa_release(ch->state);
+    numa_release(ch->best);
+    ch->best = nullptr;
+    numa_free(ch->scratch, bytes);
+}
+
+void anneal_start(int n, const Chromosome *init) {
+    if (chains) return;
+    n_chains = std::max(2, n);
+    chains = new Chain[n_chains];
+    ladder = new double[n_chains];
+    holder = new int[n_chains];
+    exchange_seed = seed;
+    running = true;
+    for (int i = 0; i < n_chains; i++) {
+        ladder[i] = ANNEAL_T_MIN * pow(ANNEAL_T_MAX / ANNEAL_T_MIN, (double) i / (n_chains - 1));
+        chains[i].temp = i;
+        chains[i].thread = std::thread(chain_run, &chains[i], i + 1, &init[i % params.pop_size], seed + i + 1);
+    }
+    while (ready < n_chains) std::this_thread::yield(); // init must stay valid until every chain has its copy
+}
+
+void anneal_stop() {
+    if (!running.exchange(false)) return;
+    for (int i = 0; i < n_chains; i++) chains[i].thread.join();
+}
+
+void anneal_exchange() {
+    unsigned int &seed = exchange_seed;
+
+    for (int i = 0; i < n_chains; i++) holder[chains[i].temp.load()] = i;
+
+    // Swap temperatures of neighbours with probability min(1, exp((E_a - E_b) * (1 / T_a - 1 / T_b)))
+    for (int k = 0; k + 1 < n_chains; k++) {
+        Chain &a = chains[holder[k]], &b = chains[holder[k + 1]];
+        double x = (double) (a.energy.load() - b.energy.load()) * (1 / ladder[k] - 1 / ladder[k + 1]);
+        if (x >= 0 || U_RND < exp(x)) {
+            a.temp.store(k + 1);
+            b.temp.store(k);
+            std::swap(holder[k], holder[k + 1]);
+        }
+    }
+}
+
+bool anneal_best(Chromosome &out) {
+    int best = -1;
+    ll best_fit = out.fit_val;
+    for (int i = 0; i < n_chains; i++) {
+        std::lock_guard<std::mutex> lock(chains[i].m);
+        if (chains[i].best && chains[i].best->fit_val < best_fit) {
+            best = i;
+            best_fit = chains[i].best->fit_val;
+        }
+    }
+    if (best < 0) return false;
+    {
+        std::lock_guard<std::mutex> lock(chains[best].m);
+        if (!chains[best].best) return false;
+        out.copy_genome(*chains[best].best);
+    }
+    out.fitness(); // renders the window of the genome, out.fit_val already holds its value
+    return true;
+}
+
+long anneal_steps() {
+    long total = 0;
+    for (int i = 0; i < n_chains; i++) total += chains[i].steps.load(std::memory_order_relaxed);
+    return total;
+}
@@ -0,0 +1,32 @@
+/*
+ * Parallel tempering: an alternative optimizer to the genetic algorithm of gl_idle.
+ * Every thread runs one simulated annealing chain doing single triangle mutations scored incrementally.
+ * Periodically, chains at adjacent temperatures may swap their temperatures (replica exchange). Only the temperature
+ * indices move between chains, never the genomes, so the chains share nothing but a few atomics.
+ */
+
+#ifndef ANNEAL_H
+#define ANNEAL_H
+
+#include "chromosome.h"
+
+#define ANNEAL_T_MIN 2e3      // Temperature of the coldest chain, in units of squared error
+#define ANNEAL_T_MAX 2e6      // Temperature of the hottest chain
+#define ANNEAL_EXCHANGE_MS 20 // Delay between two replica exchange sweeps
+
+// Starts the given number of chains (at least 2), chain i starts from init[i]
+void anneal_start(int chains, const Chromosome *init);
+
+// Stops and joins the chains, safe to call more than once
+void anneal_stop();
+
+// One replica exchange sweep over all pairs of adjacent temperatures
+void anneal_exchange();
+
+// Copies the best state any chain has reached into out and renders it, false if it is not better than out already
+bool anneal_best(Chromosome &out);
+
+// Total number of mutations tried by all the chains
+long anneal_steps();
+
+#endif // ANNEAL_H
@@ -0,0 +1,104 @@
+/*
+ * Time-budgeted anytime mode, see anytime.h
+ */
+
+#include "anytime.h"
+#include <ctime>
+#include <cmath>
+#include <mutex>
+#include <algorithm>
+
+static unsigned char *full_pixel = nullptr; // the original image while input holds a coarser level
+static long full_width, full_height;
+static unsigned char *level_pixel = nullptr;
+
+static std::mutex best_mutex;
+static double best_point[N][V][2], best_color[N][4];
+static unsigned char best_shape[N];
+static double best_vertex[MESH_VERTICES][2];
+static unsigned short best_index[N][V];
+static ll best_fit = -1;
+
+double now_seconds() {
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+AnytimePlan anytime_plan(double budget, double full_eval_seconds) {
+    AnytimePlan plan{};
+
+    // Finest level that still affords enough evaluations, the cost of a render scales with the pixel count
+    for (plan.level = 0; plan.level < ANYTIME_MAX_LEVEL; plan.level++) {
+        if (budget / (full_eval_seconds / (1 << (2 * plan.level))) >= ANYTIME_MIN_EVALS) break;
+    }
+    plan.eval_seconds = full_eval_seconds / (1 << (2 * plan.level));
+
+    // Population small enough for ANYTIME_GENERATIONS generations (75% of a population is bred per generation)
+    double evals = budget / plan.eval_seconds;
+    plan.pop_size = std::min(POP_SIZE, std::max(ANYTIME_MIN_POP, (int) (evals / (0.75 * ANYTIME_GENERATIONS))));
+
+    // Short runs cannot wait for crossover to pay off, they lean on hill climbing by disturb mutations
+    plan.crossover = evals < ANYTIME_MIN_EVALS ? 0.5 : 0.95;
+    return plan;
+}
+
+void set_resolution(int level) {
+    if (!full_pixel) {
+        full_pixel = input.pixel;
+        full_width = input.width;
+        full_height = input.height;
+    }
+    delete[] level_pixel;
+    level_pixel = nullptr;
+    input.pixel = full_pixel;
+    input.width = full_width;
+    input.height = full_height;
+    if (level <= 0) return;
+
+    // Box filter of 2^level x 2^level blocks
+    int f = 1 << level;
+    long w = full_width / f, h = full_height / f;
+    level_pixel = new unsigned char[w * h * channels];
+    for (long y = 0; y < h; y++) {
+        for (long x = 0; x < w; x++) {
+            for (int k = 0; k < channels; k++) {
+                int sum = 0;
+                for (int dy = 0; dy < f; dy++)
+                    for (int dx = 0; dx < f; dx++)
+                        sum += full_pixel[((y * f + dy) * full_width + x * f + dx) * channels + k];
+                level_pixel[(y * w + x) * channels + k] = (unsigned char) ((sum + f * f / 2) / (f * f));
+            }
+        }
+    }
+    input.pixel = level_pixel;
+    input.width = w;
+    input.height = h;
+}
+
+void best_publish(const Chromosome &c) {
+    std::lock_guard<std::mutex> lock(best_mutex);
+    if (best_fit >= 0 && c.fit_val >= best_fit) return;
+    memcpy(best_point, c.point, sizeof(best_point));
+    memcpy(best_color, c.color, sizeof(best_color));
+    memcpy(best_shape, c.shape, sizeof(best_shape));
+    memcpy(best_vertex, c.vertex, sizeof(best_vertex));
+    memcpy(best_index, c.index, sizeof(best_index));
+    best_fit = c.fit_val;
+}
+
+void best_reset() {
+    std::lock_guard<std::mutex> lock(best_mutex);
+    best_fit = -1;
+}
+
+ll best_fetch(Chromosome &c) {
+    std::lock_guard<std::mutex> lock(best_mutex);
+    if (best_fit < 0) return -1; // nothing published (yet, or since best_reset), c is left as it is
+    memcpy(c.point, best_point, sizeof(best_point));
+    memcpy(c.color, best_color, sizeof(best_color));
+    memcpy(c.shape, best_shape, sizeof(best_shape));
+    memcpy(c.vertex, best_vertex, sizeof(best_vertex));
+    memcpy(c.index, best_index, sizeof(best_index));
+    return best_fit;
+}
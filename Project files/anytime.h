@@ -0,0 +1,39 @@
+/*
+ * Time-budgeted anytime mode
+ * Given a wall-clock budget, the planner picks the resolution the fitness is computed at, the population size and the
+ * operator mix. While the run goes on, the best chromosome so far is published as a snapshot that any thread can read
+ * at any instant.
+ */
+
+#ifndef ANYTIME_H
+#define ANYTIME_H
+
+#include "chromosome.h"
+
+#define ANYTIME_MAX_LEVEL 3     // Coarsest resolution level, the image is halved per level (512 -> 64)
+#define ANYTIME_MIN_EVALS 3000  // Fitness evaluations a budget should afford before a finer level is picked
+#define ANYTIME_GENERATIONS 60  // Generations the population size is chosen to fit in the budget
+#define ANYTIME_MIN_POP 8       // Smallest population the planner picks
+
+struct AnytimePlan {
+    int level;           // resolution level, 0 is the input image
+    int pop_size;        // population size, at most POP_SIZE
+    double crossover;    // share of the children produced by crossover
+    double eval_seconds; // expected cost of one fitness evaluation at that level
+};
+
+// Wall clock time in seconds, monotonic
+double now_seconds();
+
+// Plan for a budget of the given seconds, knowing what one evaluation costs at full resolution
+AnytimePlan anytime_plan(double budget, double full_eval_seconds);
+
+// Switches input to the given resolution level (box filtered), level 0 restores the original image
+void set_resolution(int level);
+
+// Best-so-far snapshot: publish() keeps it if c is better, fetch() copies it out, both are thread safe
+void best_publish(const Chromosome &c);
+ll best_fetch(Chromosome &c); // genome only, c.window is left as it is; -1 (c untouched) if nothing was published
+void best_reset();            // forgets the snapshot, after the fitness values changed meaning (new target)
+
+#endif // ANYTIME_H
@@ -0,0 +1,131 @@
+/*
+ * Hyperparameter auto-tuner, see autotune.h
+ */
+
+#include "autotune.h"
+#include <cmath>
+#include <thread>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+double relative_error(ll fit) {
+    static ll blank = 0;
+    static const unsigned char *blank_of = nullptr; // input the cached value belongs to
+    if (blank_of != input.pixel) {
+        unsigned char *black = (unsigned char *) calloc(input.width * input.height, channels);
+        blank = rect_error(black, input.pixel, input.width, {0, 0, (int) input.width, (int) input.height});
+        free(black);
+        blank_of = input.pixel;
+    }
+    return blank ? (double) fit / blank : 0;
+}
+
+// Random point of the search space
+static Params sample_params(const Params &base) {
+    Params p = base;
+    p.pop_size = 10 + rand_r(&seed) % (POP_SIZE - 9);
+    p.triangles = 20 + rand_r(&seed) % (N - 19);
+    p.opacity = 0.05 + 0.45 * U_RND;
+    p.elite = 0.1 + 0.4 * U_RND;
+    p.crossover = U_RND;
+    p.one_point = U_RND;
+    p.disturb = 0.5 + 0.5 * U_RND;
+    p.adaptive = U_RND < 0.5;
+    return p;
+}
+
+// Writes s to out as a single shell word, quoted ('\'' for every quote it holds)
+static void shell_quote(FILE *out, const char *s) {
+    fputc('\'', out);
+    for (; *s; s++) {
+        if (*s == '\'') fputs("'\\''", out);
+        else fputc(*s, out);
+    }
+    fputc('\'', out);
+}
+
+// Command line running one trial of p on image, for a budget of the given CPU seconds (malloc'ed, to be freed)
+static char *trial_command(const char *exe, const char *image, const Params &p, double budget, double target) {
+    char *cmd = nullptr, *saved = nullptr;
+    size_t cmd_size = 0, saved_size = 0;
+    FILE *out = open_memstream(&cmd, &cmd_size);
+    shell_quote(out, exe);
+    fputs(" --input ", out);
+    shell_quote(out, image);
+    fprintf(out, " --trial %g --target %g --set threads=0", budget, target);
+
+    FILE *mem = open_memstream(&saved, &saved_size);
+    save_params(mem, p);
+    fclose(mem);
+
+    // Every "key = value" line becomes a --set key=value (threads stays 0: trials run side by side)
+    for (char *l = strtok(saved, "\n"); l; l = strtok(nullptr, "\n")) {
+        char key[64], value[64];
+        if (sscanf(l, "%63s = %63s", key, value) == 2 && strcmp(key, "threads") != 0)
+            fprintf(out, " --set %s=%s", key, value);
+    }
+    free(saved);
+    fputs(" 2>/dev/null", out);
+    fclose(out);
+    return cmd;
+}
+
+int autotune(const char *out_file, const char *const *images, int n_images, double target) {
+    char exe[1024];
+    ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (len <= 0) return 1;
+    exe[len] = 0;
+
+    int n = AUTOTUNE_CONFIGS, jobs = std::max(1, (int) std::thread::hardware_concurrency());
+    Params configs[AUTOTUNE_CONFIGS];
+    double score[AUTOTUNE_CONFIGS];
+    int alive[AUTOTUNE_CONFIGS];
+    configs[0] = params;
+    for (int i = 1; i < n; i++) configs[i] = sample_params(params);
+    for (int i = 0; i < n; i++) alive[i] = i;
+
+    for (double budget = AUTOTUNE_BUDGET; n > 1; budget *= 2) {
+        printf("Autotune: %d configurations, %d images, %gs per trial\n", n, n_images, budget);
+        for (int i = 0; i < n; i++) score[alive[i]] = 0;
+
+        // Trials run in batches of one per core
+        int trials = n * n_images;
+        for (int first = 0; first < trials; first += jobs) {
+            int last = std::min(trials, first + jobs);
+            std::vector<FILE *> pipes(last - first);
+            for (int t = first; t < last; t++) {
+                char *cmd = trial_command(exe, images[t % n_images], configs[alive[t / n_images]], budget, target);
+                pipes[t - first] = popen(cmd, "r");
+                free(cmd);
+            }
+            for (int t = first; t < last; t++) {
+                // Time to target, extrapolated from the error reached when the target was missed
+                double cpu = budget, err = 1;
+                char line[256];
+                while (pipes[t - first] && fgets(line, sizeof(line), pipes[t - first]))
+                    sscanf(line, "Trial: cpu=%lf error=%lf", &cpu, &err);
+                if (pipes[t - first]) pclose(pipes[t - first]);
+                score[alive[t / n_images]] += (err <= target ? cpu : budget * err / target) / n_images;
+            }
+        }
+
+        // The better half survives
+        std::sort(alive, alive + n, [&](int a, int b) { return score[a] < score[b]; });
+        for (int i = 0; i < n; i++) printf("  #%-2d %s%.3fs to target\n", alive[i], i < (n + 1) / 2 ? "* " : "  ", score[alive[i]]);
+        n = (n + 1) / 2;
+    }
+
+    FILE *out = fopen(out_file, "w");
+    if (!out) {
+        fprintf(stderr, "Cannot write %s\n", out_file);
+        return 1;
+    }
+    fprintf(out, "# Tuned on %d image(s) for a target relative error of %g, %.3f CPU-seconds to target\n",
+            n_images, target, score[alive[0]]);
+    save_params(out, configs[alive[0]]);
+    fclose(out);
+    printf("Best configuration (#%d) written to %s:\n", alive[0], out_file);
+    save_params(stdout, configs[alive[0]]);
+    return 0;
+}
@@ -0,0 +1,24 @@
+/*
+ * Hyperparameter auto-tuner
+ * Successive halving over random configurations: every surviving configuration runs a short headless trial on each
+ * sample image (trials run in parallel, as separate processes of this same executable), the better half survives and
+ * the trial budget doubles, until one configuration is left. Configurations are ranked by their CPU time to reach a
+ * target fitness, so the result is the best quality per CPU-second on this host.
+ */
+
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include "chromosome.h"
+
+#define AUTOTUNE_CONFIGS 16  // Configurations in the first round (the current one and random ones)
+#define AUTOTUNE_BUDGET 2.0  // CPU seconds of a trial in the first round, doubled every round
+#define AUTOTUNE_TARGET 0.45 // Default target, as a fitness relative to the error of a blank canvas
+
+// Fitness relative to that of a blank (black) canvas on the current input, the scale targets are given in
+double relative_error(ll fit);
+
+// Tunes params on the given images towards target and writes the best configuration to out_file
+int autotune(const char *out_file, const char *const *images, int n_images, double target);
+
+#endif // AUTOTUNE_H
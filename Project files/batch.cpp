@@ -0,0 +1,265 @@
+/*
+ * Batched thumbnail jobs, see batch.h
+ * A BatchChromosome holds one chromosome of every job: each number of the genome is an array with one lane per job.
+ * Rendering is done in floats a row at a time: the coverage of a pixel is the sign of the three edge functions of the
+ * triangle, evaluated for all lanes at once, and the row is diffed against the targets right after it is blended.
+ */
+
+#include "batch.h"
+#include "chromosome.h"
+#include "anytime.h"
+#include <algorithm>
+
+typedef float lanes[BATCH_LANES] __attribute__((aligned(64))); // one number of every job
+
+struct BatchChromosome {
+    lanes point[BATCH_TRIANGLES][V][2]; // normalized coordinates, as in Chromosome
+    lanes color[BATCH_TRIANGLES][3];    // RGB, the opacity is params.opacity
+    double fit[BATCH_LANES];            // squared error of every lane against the target of its job
+};
+
+// Triangle set up for rasterization: edge functions a * x + b * y + c (in pixels) positive inside, and the pixels
+// the triangle may cover in any lane
+struct BatchEdges {
+    lanes a[3], b[3], c[3];
+    int x0, y0, x1, y1;
+};
+
+struct Batch {
+    BatchChromosome pop[BATCH_POP], kid[BATCH_POP - BATCH_ELITE];
+    int rank[BATCH_LANES][BATCH_POP]; // slots of pop of every job, best first
+    unsigned int seed[BATCH_LANES];   // random numbers seed of every job
+    lanes target[BATCH_SIZE][BATCH_SIZE][3]; // reference pixels (0 to 255), bottom-up like the BMP rows
+    double blank[BATCH_LANES];               // error of a black canvas, to report relative errors
+};
+
+static Batch batch;
+static unsigned char rendered[BATCH_LANES][BATCH_SIZE * BATCH_SIZE * 3];
+
+// Renders c for every lane and stores its error in c.fit, with out the render is also written there as RGB bytes
+// Every loop over the lanes has a fixed trip count of BATCH_LANES, so each compiles to a few vector instructions
+MULTIVERSION static void render(BatchChromosome &c, const lanes (*target)[BATCH_SIZE][3],
+                                unsigned char (*out)[BATCH_SIZE * BATCH_SIZE * 3]) {
+    const float alpha = params.opacity;
+    BatchEdges e[BATCH_TRIANGLES];
+    for (int t = 0; t < BATCH_TRIANGLES; t++) {
+        BatchEdges &s = e[t];
+        float min_x = BATCH_SIZE, max_x = 0, min_y = BATCH_SIZE, max_y = 0;
+        for (int l = 0; l < BATCH_LANES; l++) {
+            float x[V], y[V];
+            for (int k = 0; k < V; k++) {
+                x[k] = c.point[t][k][0][l] * BATCH_SIZE;
+                y[k] = c.point[t][k][1][l] * BATCH_SIZE;
+                min_x = std::min(min_x, x[k]);
+                max_x = std::max(max_x, x[k]);
+                min_y = std::min(min_y, y[k]);
+                max_y = std::max(max_y, y[k]);
+            }
+            // Orientation of the triangle, degenerate ones (sign 0) cover nothing
+            float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+            float sign = area > 0 ? 1 : area < 0 ? -1 : 0;
+            for (int k = 0; k < V; k++) {
+                int j = (k + 1) % V;
+                s.a[k][l] = -(y[j] - y[k]) * sign;
+                s.b[k][l] = (x[j] - x[k]) * sign;
+                s.c[k][l] = ((y[j] - y[k]) * x[k] - (x[j] - x[k]) * y[k]) * sign;
+            }
+        }
+        s.x0 = std::max(0, (int) min_x);
+        s.y0 = std::max(0, (int) min_y);
+        s.x1 = std::min(BATCH_SIZE, (int) max_x + 1);
+        s.y1 = std::min(BATCH_SIZE, (int) max_y + 1);
+    }
+
+    double err[BATCH_LANES] = {};
+    lanes row[BATCH_SIZE][3];
+    for (int y = 0; y < BATCH_SIZE; y++) {
+        memset(row, 0, sizeof(row));
+        float cy = y + 0.5f;
+        for (int t = 0; t < BATCH_TRIANGLES; t++) {
+            const BatchEdges &s = e[t];
+            if (y < s.y0 || y >= s.y1) continue;
+            float cx = s.x0 + 0.5f;
+            lanes e0, e1, e2;
+            for (int l = 0; l < BATCH_LANES; l++) {
+                e0[l] = s.a[0][l] * cx + s.b[0][l] * cy + s.c[0][l];
+                e1[l] = s.a[1][l] * cx + s.b[1][l] * cy + s.c[1][l];
+                e2[l] = s.a[2][l] * cx + s.b[2][l] * cy + s.c[2][l];
+            }
+            const lanes *col = c.color[t];
+            for (int x = s.x0; x < s.x1; x++) {
+                lanes *px = row[x];
+                for (int l = 0; l < BATCH_LANES; l++) {
+                    float w = (e0[l] > 0) & (e1[l] > 0) & (e2[l] > 0) ? alpha : 0;
+                    px[0][l] += w * (col[0][l] - px[0][l]);
+                    px[1][l] += w * (col[1][l] - px[1][l]);
+                    px[2][l] += w * (col[2][l] - px[2][l]);
+                    e0[l] += s.a[0][l];
+                    e1[l] += s.a[1][l];
+                    e2[l] += s.a[2][l];
+                }
+            }
+        }
+
+        lanes sum = {};
+        for (int x = 0; x < BATCH_SIZE; x++) {
+            for (int k = 0; k < 3; k++) {
+                for (int l = 0; l < BATCH_LANES; l++) {
+                    float d = row[x][k][l] * 255 - target[y][x][k][l];
+                    sum[l] += d * d;
+                }
+            }
+        }
+        for (int l = 0; l < BATCH_LANES; l++) err[l] += sum[l];
+
+        if (!out) continue;
+        for (int l = 0; l < BATCH_LANES; l++)
+            for (int x = 0; x < BATCH_SIZE; x++)
+                for (int k = 0; k < 3; k++)
+                    out[l][(y * BATCH_SIZE + x) * 3 + k] = (unsigned char) (row[x][k][l] * 255 + 0.5f);
+    }
+    memcpy(c.fit, err, sizeof(err));
+}
+
+// Random triangle t in lane l of c
+static void random_triangle(BatchChromosome &c, int t, int l, unsigned int &seed) {
+    for (int k = 0; k < V; k++) {
+        c.point[t][k][0][l] = U_RND;
+        c.point[t][k][1][l] = U_RND;
+    }
+    for (int k = 0; k < 3; k++) c.color[t][k][l] = U_RND;
+}
+
+// Copies triangle t of lane l from src to dst
+static void copy_triangle(BatchChromosome &dst, const BatchChromosome &src, int t, int l) {
+    for (int k = 0; k < V; k++) {
+        dst.point[t][k][0][l] = src.point[t][k][0][l];
+        dst.point[t][k][1][l] = src.point[t][k][1][l];
+    }
+    for (int k = 0; k < 3; k++) dst.color[t][k][l] = src.color[t][k][l];
+}
+
+// Child of job l: two parents from the better half, crossed over triangle by triangle, then a few small mutations
+static void breed(BatchChromosome &child, int l, unsigned int &seed) {
+    const BatchChromosome &a = batch.pop[batch.rank[l][rand_r(&seed) % (BATCH_POP / 2)]];
+    const BatchChromosome &b = batch.pop[batch.rank[l][rand_r(&seed) % (BATCH_POP / 2)]];
+    bool cross = U_RND < params.crossover;
+    for (int t = 0; t < BATCH_TRIANGLES; t++) copy_triangle(child, cross && U_RND < 0.5 ? b : a, t, l);
+
+    for (int m = 1 + rand_r(&seed) % 3; m > 0; m--) {
+        int t = rand_r(&seed) % BATCH_TRIANGLES;
+        double kind = U_RND;
+        if (kind < 0.1) {
+            random_triangle(child, t, l, seed);
+        } else if (kind < 0.6) {
+            lanes &p = child.point[t][rand_r(&seed) % V][rand_r(&seed) % 2];
+            p[l] = std::min(1.0, std::max(0.0, p[l] + RND * 0.1));
+        } else {
+            lanes &p = child.color[t][rand_r(&seed) % 3];
+            p[l] = std::min(1.0, std::max(0.0, p[l] + RND * 0.1));
+        }
+    }
+}
+
+// Box filters image into lane l of the targets
+static void load_target(const ImageReader &image, int l) {
+    long w = image.width, h = image.height;
+    batch.blank[l] = 0;
+    for (int y = 0; y < BATCH_SIZE; y++) {
+        for (int x = 0; x < BATCH_SIZE; x++) {
+            long x0 = x * w / BATCH_SIZE, x1 = std::max(x0 + 1, (x + 1) * w / BATCH_SIZE);
+            long y0 = y * h / BATCH_SIZE, y1 = std::max(y0 + 1, (y + 1) * h / BATCH_SIZE);
+            for (int k = 0; k < 3; k++) {
+                double sum = 0;
+                for (long py = y0; py < y1 && py < h; py++)
+                    for (long px = x0; px < x1 && px < w; px++)
+                        sum += image.pixel[(py * w + px) * image.channels + (image.channels == 1 ? 0 : k)];
+                float v = sum / ((x1 - x0) * (y1 - y0));
+                batch.target[y][x][k][l] = v;
+                batch.blank[l] += v * v;
+            }
+        }
+    }
+}
+
+// Evolves the jobs loaded in the lanes of batch
+static void batch_evolve(unsigned int base_seed) {
+    for (int l = 0; l < BATCH_LANES; l++) {
+        unsigned int &seed = batch.seed[l];
+        seed = base_seed + 7919 * l;
+        for (auto &c : batch.pop)
+            for (int t = 0; t < BATCH_TRIANGLES; t++) random_triangle(c, t, l, seed);
+    }
+    for (auto &c : batch.pop) render(c, batch.target, nullptr);
+    auto sort_job = [](int l) {
+        int *r = batch.rank[l];
+        std::sort(r, r + BATCH_POP, [l](int a, int b) { return batch.pop[a].fit[l] < batch.pop[b].fit[l]; });
+    };
+    for (int l = 0; l < BATCH_LANES; l++) {
+        for (int i = 0; i < BATCH_POP; i++) batch.rank[l][i] = i;
+        sort_job(l);
+    }
+
+    for (int g = 0; g < BATCH_GENERATIONS; g++) {
+        for (int l = 0; l < BATCH_LANES; l++)
+            for (auto &kid : batch.kid) breed(kid, l, batch.seed[l]);
+        for (auto &kid : batch.kid) render(kid, batch.target, nullptr);
+
+        // The children of a job take the slots of its non-elite chromosomes, which may differ from lane to lane
+        for (int l = 0; l < BATCH_LANES; l++) {
+            for (int j = 0; j < BATCH_POP - BATCH_ELITE; j++) {
+                BatchChromosome &dst = batch.pop[batch.rank[l][BATCH_ELITE + j]];
+                for (int t = 0; t < BATCH_TRIANGLES; t++) copy_triangle(dst, batch.kid[j], t, l);
+                dst.fit[l] = batch.kid[j].fit[l];
+            }
+            sort_job(l);
+        }
+    }
+}
+
+int run_batch(const char *list_file) {
+    FILE *list = fopen(list_file, "r");
+    if (!list) {
+        fprintf(stderr, "Cannot read %s\n", list_file);
+        return 1;
+    }
+    char in[BATCH_LANES][512], out[BATCH_LANES][512];
+    int jobs = 0, failed = 0;
+    double start = now_seconds();
+    bool more = true;
+    while (more) {
+        // Fill the lanes, the ones left over in the last batch just run on a black target
+        int n = 0;
+        memset(batch.target, 0, sizeof(batch.target));
+        while (n < BATCH_LANES && (more = fscanf(list, "%511s %511s", in[n], out[n]) == 2)) {
+            ImageReader image;
+            if (!image.LoadBmpFile(in[n])) {
+                fprintf(stderr, "Cannot read %s\n", in[n]);
+                failed++;
+                continue;
+            }
+            load_target(image, n++);
+            image.Reset();
+        }
+        if (!n) break;
+
+        batch_evolve(seed + jobs);
+        BatchChromosome &best = batch.kid[0];
+        for (int l = 0; l < BATCH_LANES; l++)
+            for (int t = 0; t < BATCH_TRIANGLES; t++) copy_triangle(best, batch.pop[batch.rank[l][0]], t, l);
+        render(best, batch.target, rendered);
+        for (int l = 0; l < n; l++) {
+            if (!ImageReader::WriteBmpFile(out[l], rendered[l], BATCH_SIZE, BATCH_SIZE)) failed++;
+            printf("%s -> %s, relative error %.5f\n", in[l], out[l], batch.blank[l] ? best.fit[l] / batch.blank[l] : 0);
+        }
+        jobs += n;
+    }
+    fclose(list);
+
+    double seconds = now_seconds() - start;
+    double evals = (double) ((jobs + BATCH_LANES - 1) / BATCH_LANES) * BATCH_LANES *
+                   (BATCH_POP + (double) BATCH_GENERATIONS * (BATCH_POP - BATCH_ELITE));
+    printf("Batch: %d thumbnails in %.2fs, %.2f thumbnails/s, %.0f evaluations/s (%d lanes of %dx%d)\n",
+           jobs, seconds, jobs / seconds, evals / seconds, BATCH_LANES, BATCH_SIZE, BATCH_SIZE);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,22 @@
+/*
+ * Batched thumbnail jobs
+ * Many small, independent images are fitted side by side: every job is one lane of a SIMD vector, with its own
+ * population, random seed and target. A single rasterize and diff pass then renders and scores one chromosome of
+ * every job of the batch at once. Per-job overheads (threads, queues, the OpenGL window and
+ * the 512x512 display) are gone, which is what dominates when the images are tiny.
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#define BATCH_LANES 16        // Jobs processed together, one per lane (16 floats fill an AVX-512 register)
+#define BATCH_SIZE 64         // Thumbnails are fitted at BATCH_SIZE x BATCH_SIZE
+#define BATCH_POP 24          // Population of each job
+#define BATCH_ELITE 6         // Best chromosomes of a job kept as they are every generation
+#define BATCH_TRIANGLES 64    // Triangles of a thumbnail chromosome
+#define BATCH_GENERATIONS 600// Generations every job runs for
+
+// Runs the jobs listed in list_file, one "input.bmp output.bmp" pair per line, the outputs are BATCH_SIZE wide
+int run_batch(const char *list_file);
+
+#endif // BATCH_H
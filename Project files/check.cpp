@@ -0,0 +1,127 @@
+/*
+ * Headless self-checks, see check.h
+ */
+
+#include "check.h"
+#include "mpmc.h"
+#include "evolog.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#define CHECK_TEMPS 8         // Temporary files a run of the checks may create
+#define CHECK_THREADS 4       // Producers, and as many consumers, of the queue check
+#define CHECK_ITEMS 100000    // Items every producer pushes
+#define CHECK_EDITS 3         // Triangles changed between two entries of the logged run
+
+static int failures = 0;
+static char temps[CHECK_TEMPS][32];
+static int n_temps = 0;
+
+bool check(const char *name, bool ok) {
+    printf("%s: %s\n", ok ? "PASS" : "FAIL", name);
+    if (!ok) failures++;
+    return ok;
+}
+
+int check_failures() {
+    return failures;
+}
+
+const char *check_temp() {
+    if (n_temps == CHECK_TEMPS) return "/dev/null";
+    char *path = temps[n_temps];
+    strcpy(path, "/tmp/geneticart-XXXXXX");
+    int fd = mkstemp(path);
+    if (fd < 0) return "/dev/null";
+    close(fd);
+    n_temps++;
+    return path;
+}
+
+void check_cleanup() {
+    for (int i = 0; i < n_temps; i++) unlink(temps[i]);
+    n_temps = 0;
+}
+
+void check_mpmc() {
+    static MpmcQueue<int, 64> q;
+    int v;
+    bool ok = !q.pop(v);
+    for (int i = 0; i < 64; i++) ok &= q.push(i);
+    ok &= !q.push(64);
+    for (int i = 0; i < 64; i++) ok &= q.pop(v) && v == i;
+    ok &= !q.pop(v);
+    check("MPMC queue reports full and empty, keeps the order", ok);
+
+    // Producers and consumers at once: every item comes out exactly once
+    std::vector<std::atomic<int>> seen(CHECK_THREADS * CHECK_ITEMS);
+    std::atomic<int> taken(0);
+    std::vector<std::thread> pool;
+    for (int t = 0; t < CHECK_THREADS; t++) {
+        pool.emplace_back([&, t] {
+            for (int i = t * CHECK_ITEMS; i < (t + 1) * CHECK_ITEMS; i++)
+                while (!q.push(i)) std::this_thread::yield();
+        });
+        pool.emplace_back([&] {
+            int item;
+            while (taken.load() < CHECK_THREADS * CHECK_ITEMS) {
+                if (!q.pop(item)) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                seen[item]++;
+                taken++;
+            }
+        });
+    }
+    for (auto &t : pool) t.join();
+    ok = !q.pop(v);
+    for (auto &s : seen) ok &= s.load() == 1;
+    check("MPMC queue delivers every item exactly once across threads", ok);
+}
+
+// Random triangles, rounded to floats as the log stores them, so that a replay renders them exactly
+static void randomize(Chromosome &c, int t) {
+    for (int k = 0; k < V; k++)
+        for (int axis = 0; axis < 2; axis++) c.point[t][k][axis] = (float) U_RND;
+    for (int k = 0; k < 4; k++) c.color[t][k] = (float) U_RND;
+    c.shape[t] = random_shape();
+}
+
+// Whether the image at path is the render of c
+static bool renders(const char *path, Chromosome &c) {
+    Rect all = {0, 0, (int) input.width, (int) input.height};
+    render_rect(c.point, c.shape, c.color, params.triangles, c.window, input.width, input.height, all);
+    ImageReader frame;
+    return frame.LoadBmpFile(path) && frame.width == input.width && frame.height == input.height &&
+           frame.channels == channels &&
+           memcmp(frame.pixel, c.window, (size_t) input.width * input.height * channels) == 0;
+}
+
+void check_evolog() {
+    const char *log = check_temp(), *frame = check_temp();
+    Chromosome *c = new Chromosome(), *at = new Chromosome();
+    for (int t = 0; t < params.triangles; t++) randomize(*c, t);
+
+    // Over two keyframes, so that a replay in the middle builds on a keyframe and diffs after it
+    int entries = 2 * LOG_KEYFRAME + CHECK_EDITS, middle = LOG_KEYFRAME + LOG_KEYFRAME / 2;
+    bool ok = evolog_open(log);
+    for (int e = 0; e < entries && ok; e++) {
+        for (int i = 0; i < CHECK_EDITS; i++) randomize(*c, rand_r(&seed) % params.triangles);
+        c->fit_val = entries - e; // an entry is only written when the fitness changes
+        evolog_record(e, *c);
+        if (e == middle) at->copy_genome(*c);
+    }
+    evolog_close();
+    check("evolution log replays an epoch between keyframes",
+          ok && evolog_replay(log, 1, middle, frame, 2) == 0 && renders(frame, *at));
+    check("evolution log replays the last epoch", ok && evolog_replay(log, 1, -1, frame, 2) == 0 && renders(frame, *c));
+    free(c->window);
+    free(at->window);
+    delete c;
+    delete at;
+}
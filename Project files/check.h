@@ -0,0 +1,27 @@
+/*
+ * Headless self-checks (--check)
+ * Small end-to-end tests of the parts that are easy to get subtly wrong and hard to see go wrong in a window: every
+ * check prints one PASS or FAIL line, the run fails (exit status 1) if any of them did.
+ */
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#define CHECK_DEADLINE_MS 1 // Budget of the anytime check, too short for a single generation
+
+// Reports the outcome of one check, returns ok
+bool check(const char *name, bool ok);
+
+// Number of failed checks so far
+int check_failures();
+
+// Path of a new empty temporary file, removed by check_cleanup()
+const char *check_temp();
+void check_cleanup();
+
+// Checks of the modules, each reports through check() (check_viewer is in viewer.cpp, it needs the internals)
+void check_mpmc();   // the lock-free queue of the pipeline (see mpmc.h), from several threads at once
+void check_evolog(); // delta encoding of the evolution log (see evolog.h): a replay renders what was logged
+void check_viewer(); // seqlocked frame ring of --share (see viewer.h), read while a writer goes around it
+
+#endif // CHECK_H
@@ -0,0 +1,308 @@
+/*
+ * Chromosome representation and the tunables shared by all the source files of the project
+ */
+
+#ifndef CHROMOSOME_H
+#define CHROMOSOME_H
+
+#include <GL/glut.h>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include "image_reader.h"
+#include "raster.h"
+#include "config.h"
+#include "numa.h"
+#include "detail.h"
+
+// Used macros
+#define POP_SIZE 100  // Population size (capacity, params.pop_size are in use)
+#define N 200         // Number of triangles per chromosome (capacity, params.triangles are in use)
+#define V 3          // A triangle has 3 vertices (other primitives are encoded with 3 points as well, see Shape)
+#define SCALE 512    // Input image, output image, window size are all 512x512
+#define OPACITY 0.15 // Alpha channel value for triangles (default of params.opacity)
+
+// Random number generators, the second one is uniform
+// Both use whatever 'seed' is in scope, so a thread can declare its own local seed and use them safely
+#define RND (2.0 * (double)rand_r(&seed) / RAND_MAX - 1.0)
+#define U_RND ( (double)rand_r (&seed) / RAND_MAX)
+#define ELLIPSE_SEGMENTS 32 // Triangles of the fan approximating an ellipse on the display
+#define MESH_VERTICES (N / 2 + 3) // Vertex pool capacity of a mesh genome (a planar mesh of N triangles has about N / 2)
+#define MESH_REWIRE 0.05          // Chance that mutate_change re-attaches a corner of a mesh triangle to another vertex
+
+static_assert(N <= GRID_MAX_PRIMITIVES, "a grid lists the primitives as unsigned short, see raster.h");
+
+extern ImageReader input; // reference image, defined in main.cpp
+extern const Rect *roi_tiles; // with a region of interest (see roi.h), the only pixels fitness() renders and scores
+extern int roi_count;
+extern thread_local unsigned int seed; // random numbers seed of the calling thread
+extern unsigned long next_id; // last id given to a chromosome, only the main thread hands out new ones
+
+// Random primitive type among the ones allowed by params.shapes (mesh genomes only have triangles)
+inline unsigned char random_shape() {
+    if (params.mesh) return SHAPE_TRIANGLE;
+    int allowed[SHAPE_COUNT], n = 0;
+    for (int s = 0; s < SHAPE_COUNT; s++)
+        if (params.shapes >> s & 1) allowed[n++] = s;
+    return n == 1 ? allowed[0] : allowed[rand_r(&seed) % n];
+}
+
+// Vertices in the pool of a mesh genome (params.mesh)
+inline int mesh_vertices() {
+    return params.triangles / 2 + 3;
+}
+
+// Chromosome representation: a set of params.triangles (at most N) primitives of various positions/sizes/colors
+// The primitives are triangles unless params.shapes allows others (see Shape in raster.h)
+struct Chromosome {
+    double point[N][V][2]{};
+    double color[N][4]{};
+    unsigned char shape[N]{};
+
+    // Mesh genome (params.mesh): triangles are index triples into a pool of shared vertices, mutated by moving the
+    // vertices. point (and so everything that renders) holds the expanded triangles, see expand()
+    double vertex[MESH_VERTICES][2]{};
+    unsigned short index[N][V]{};
+
+    Grid grid; // which primitives overlap which part of the canvas, brought up to date by fitness(), see reindex()
+
+    ll fit_val{};
+    unsigned long id{}; // changes whenever the genome is replaced, lets background workers find their source again
+
+    unsigned char *window; // software render of this chromosome, kept up to date by fitness()
+    int home = -1;         // NUMA node window was placed on by numa_window, -1 for a plain allocation
+    size_t mapped = 0;     // bytes of the numa_alloc mapping window lives in, 0 if it came from malloc
+    Chromosome() { // ctor initializes memory for window
+        window = (unsigned char *) malloc(sizeof(unsigned char) * input.width * input.height * channels);
+    }
+
+    // Draw *this chromosome to the screen
+    // Every primitive is sent as non-overlapping triangles, so it is blended once: quads as two, ellipses as a fan
+    void draw() {
+        glBegin(GL_TRIANGLES);
+        for (int i = 0; i < params.triangles; i++) {
+            if (channels == 1) glColor4f(color[i][0], color[i][0], color[i][0], color[i][3]); // gray, see below
+            else glColor4f(color[i][0], color[i][1], color[i][2], color[i][3]); // RGBA
+            const double (*p)[2] = point[i];
+            if (shape[i] == SHAPE_ELLIPSE || shape[i] == SHAPE_CIRCLE) {
+                double rx = fabs(p[1][0] - p[0][0]), ry = fabs(p[1][1] - p[0][1]);
+                if (shape[i] == SHAPE_CIRCLE) {
+                    double r = hypot(rx * input.width, ry * input.height);
+                    rx = r / input.width;
+                    ry = r / input.height;
+                }
+                for (int k = 0; k < ELLIPSE_SEGMENTS; k++) {
+                    double a0 = 2 * M_PI * k / ELLIPSE_SEGMENTS, a1 = 2 * M_PI * (k + 1) / ELLIPSE_SEGMENTS;
+                    glVertex2f(p[0][0], p[0][1]);
+                    glVertex2f(p[0][0] + rx * cos(a0), p[0][1] + ry * sin(a0));
+                    glVertex2f(p[0][0] + rx * cos(a1), p[0][1] + ry * sin(a1));
+                }
+                continue;
+            }
+            glVertex2f(p[0][0], p[0][1]);
+            glVertex2f(p[1][0], p[1][1]);
+            glVertex2f(p[2][0], p[2][1]);
+            if (shape[i] == SHAPE_QUAD) {
+                glVertex2f(p[1][0], p[1][1]);
+                glVertex2f(p[1][0] + p[2][0] - p[0][0], p[1][1] + p[2][1] - p[0][1]);
+                glVertex2f(p[2][0], p[2][1]);
+            }
+        }
+        glEnd();
+    }
+
+    // Calculate fitness value (Mean-Square error) between *this chromosome and the input image
+    // Renders into window with the software rasterizer, so it can be called from any thread
+    ll fitness() {
+        Rect all = {0, 0, (int) input.width, (int) input.height};
+        grid_sync(grid, point, shape, params.triangles, input.width, input.height);
+        if (roi_count) {
+            ll sum = 0;
+            for (int i = 0; i < roi_count; i++) {
+                render_rect(point, shape, color, params.triangles, window, input.width, input.height, roi_tiles[i],
+                            &grid);
+                sum += rect_error(window, target_pixels(), input.width, roi_tiles[i]);
+            }
+            return sum;
+        }
+        render_rect(point, shape, color, params.triangles, window, input.width, input.height, all, &grid);
+        return rect_error(window, target_pixels(), input.width, all);
+    }
+
+    // Pixels that primitive t currently covers
+    Rect tri_rect(int t) const {
+        return shape_bounds(point[t], shape[t], input.width, input.height);
+    }
+
+    // Incremental scoring: re-renders only r into scratch and returns the change of fitness against window.
+    // r must contain everything the last edit touched, i.e. the old and new bounds of the modified triangles
+    // Only the primitives the grid places around r are rendered, so it must be up to date: call reindex() for the
+    // primitives the edit moved (and again once it is undone)
+    ll rescore(const Rect &r, unsigned char *scratch) const {
+        render_rect(point, shape, color, params.triangles, scratch, input.width, input.height, r, &grid);
+        const unsigned char *target = target_pixels();
+        return rect_error(scratch, target, input.width, r) - rect_error(window, target, input.width, r);
+    }
+
+    // Updates the grid after primitive t moved, only the cells it left and entered are touched
+    void reindex(int t) {
+        grid_update(grid, t, point, shape, params.triangles, input.width, input.height);
+    }
+
+    // Accepts the edit scored by rescore(), delta is the value it returned
+    void commit(const Rect &r, const unsigned char *scratch, ll delta) {
+        copy_rect(scratch, window, input.width, r);
+        fit_val += delta;
+    }
+
+    // Deep copy (the implicit assignment would share the window buffer)
+    void copy_from(const Chromosome &o) {
+        copy_genome(o);
+        memcpy(window, o.window, sizeof(unsigned char) * input.width * input.height * channels);
+    }
+
+    // Copy of everything but the window, which is left as it is (call fitness() to render it again)
+    void copy_genome(const Chromosome &o) {
+        memcpy(point, o.point, sizeof(point));
+        memcpy(color, o.color, sizeof(color));
+        memcpy(shape, o.shape, sizeof(shape));
+        memcpy(vertex, o.vertex, sizeof(vertex));
+        memcpy(index, o.index, sizeof(index));
+        grid_copy(grid, o.grid);
+        fit_val = o.fit_val;
+        id = o.id;
+    }
+
+    // Sorting key, a chromosome is better than another if it has a lower fit value
+    static bool key(const Chromosome &a, const Chromosome &b) {
+        return a.fit_val < b.fit_val;
+    }
+
+    // Mesh genome: rebuilds the triangles from the vertex pool
+    void expand() {
+        for (int i = 0; i < params.triangles; i++)
+            for (int k = 0; k < V; k++) {
+                point[i][k][0] = vertex[index[i][k]][0];
+                point[i][k][1] = vertex[index[i][k]][1];
+            }
+    }
+
+    // Mesh genome: pixels covered by the triangles using vertex v, the only ones a move of v re-renders
+    Rect vertex_rect(int v) const {
+        Rect r = {0, 0, 0, 0};
+        for (int i = 0; i < params.triangles; i++)
+            if (index[i][0] == v || index[i][1] == v || index[i][2] == v) r = rect_union(r, tri_rect(i));
+        return r;
+    }
+
+    // Mesh genome: updates the grid after vertex v moved
+    void reindex_vertex(int v) {
+        for (int i = 0; i < params.triangles; i++)
+            if (index[i][0] == v || index[i][1] == v || index[i][2] == v) reindex(i);
+    }
+
+    // Mesh genome: sets one coordinate of vertex v, in the pool and in the triangles using it
+    void move_vertex(int v, int axis, double value) {
+        vertex[v][axis] = value;
+        for (int i = 0; i < params.triangles; i++)
+            for (int k = 0; k < V; k++)
+                if (index[i][k] == v) point[i][k][axis] = value;
+    }
+
+    // Sets one coordinate of corner k of primitive t, or with a mesh genome of the shared vertex v (see move_vertex)
+    void set_coordinate(int t, int v, int axis, double value) {
+        if (params.mesh) move_vertex(v, axis, value);
+        else point[t][v][axis] = value;
+    }
+
+    // Pixels a move of corner v of primitive t (of the shared vertex v with a mesh genome) re-renders
+    Rect corner_rect(int t, int v) const {
+        return params.mesh ? vertex_rect(v) : tri_rect(t);
+    }
+
+    // Re-indexes what a move of corner v of primitive t (of the shared vertex v with a mesh genome) moved
+    void reindex_corner(int t, int v) {
+        if (params.mesh) reindex_vertex(v);
+        else reindex(t);
+    }
+
+    // With a grayscale target (channels = 1) only color[i][0] is used, as the luminance of the triangle
+    // Color channel a small mutation may change, one that is scored
+    static int random_channel(unsigned int &s) {
+        return channels == 1 ? 0 : rand_r(&s) % 3;
+    }
+
+    // Mutate *this chromosome by completely changing its position, color and (when several are allowed) shape
+    // Some primitives are placed by the detail of the image instead (see detail.h)
+    // A mesh re-rolls its vertices instead, and now and then re-attaches a triangle corner
+    void mutate_change() {
+        bool shapes = params.shapes & (params.shapes - 1) && !params.mesh;
+        if (params.mesh) {
+            for (int v = 0; v < mesh_vertices(); v++) {
+                if (U_RND > 0.5f) vertex[v][0] = U_RND;
+                if (U_RND > 0.5f) vertex[v][1] = U_RND;
+            }
+        }
+        for (int i = 0; i < params.triangles; i++) {
+            if (shapes && U_RND > 0.5f) shape[i] = random_shape();
+            if (params.mesh) {
+                if (U_RND < MESH_REWIRE) index[i][rand_r(&seed) % V] = rand_r(&seed) % mesh_vertices();
+            } else if (!detail_place(point[i])) {
+                for (int j = 0; j < V; j++) {
+                    if (U_RND > 0.5f) point[i][j][0] = U_RND;
+                    if (U_RND > 0.5f) point[i][j][1] = U_RND;
+                }
+            }
+            if (U_RND > 0.5f) {
+                color[i][0] = U_RND;
+                if (channels == 1) continue;
+                color[i][1] = U_RND;
+                color[i][2] = U_RND;
+            }
+        }
+        if (params.mesh) expand();
+    }
+
+    // Mutate *this chromosome by introducing small disturbance its position and color, making sure we don't go off-bounds
+    // A mesh disturbs its vertices instead
+    void mutate_disturb(double disturb) {
+        if (params.mesh) {
+            for (int v = 0; v < mesh_vertices(); v++) {
+                if (U_RND < 0.25f) {
+                    vertex[v][0] += RND / disturb;
+                    vertex[v][1] += RND / disturb;
+                }
+                if (vertex[v][0] < .0f || vertex[v][0] > 1.f) vertex[v][0] = U_RND;
+                if (vertex[v][1] < .0f || vertex[v][1] > 1.f) vertex[v][1] = U_RND;
+            }
+        }
+        for (int j = 0; j < params.triangles; j++) {
+            for (int k = 0; k < V && !params.mesh; k++) {
+                if (U_RND < 0.25f) {
+                    point[j][k][0] += RND / disturb;
+                    point[j][k][1] += RND / disturb;
+                }
+                if (point[j][k][0] < .0f || point[j][k][0] > 1.f) {
+                    point[j][k][0] = U_RND;
+                }
+                if (point[j][k][1] < .0f || point[j][k][1] > 1.f) {
+                    point[j][k][1] = U_RND;
+                }
+            }
+            if (U_RND < 0.5f) {
+                color[j][0] += 10 * RND / disturb;
+                if (channels == 3) {
+                    color[j][1] += 10 * RND / disturb;
+                    color[j][2] += 10 * RND / disturb;
+                }
+            }
+            if (color[j][0] < .0f || color[j][0] > 1.f) color[j][0] = U_RND;
+            if (channels == 1) continue;
+            if (color[j][1] < .0f || color[j][1] > 1.f) color[j][1] = U_RND;
+            if (color[j][2] < .0f || color[j][2] > 1.f) color[j][2] = U_RND;
+        }
+        if (params.mesh) expand();
+    }
+};
+
+#endif // CHROMOSOME_H
@@ -1 +1,2 @@
-gcc *.cpp -O3 -ffast-math -lglut -lGL -lGLU -fopenmp -lpthread -lstdc++ -mfpmath=sse -msse -msse2 -msse3
+# Add -DALLOC_CHECK for a build that can run the --alloc-check benchmark (it hooks the allocator of the whole process)
+gcc *.cpp -O3 -ffast-math -lglut -lGL -lGLU -fopenmp -lpthread -lstdc++ -lm -lrt -mfpmath=sse -msse -msse2 -msse3
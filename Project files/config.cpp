@@ -0,0 +1,102 @@
+/*
+ * Runtime configuration, see config.h
+ */
+
+#include "config.h"
+#include "chromosome.h"
+#include "engine.h"
+#include <cstring>
+#include <algorithm>
+
+Params params = {POP_SIZE, N, 0, 1 << SHAPE_TRIANGLE, OPACITY, RASTER_SCALAR, METRIC_SSE, 0.25, 0.95, 0.5, 0.95, 1, -1, 0, 1.0, 0.0, 101, 0};
+
+// Every parameter by name, exactly one of the member pointers is set
+static const struct {
+    const char *name;
+    int Params::*i;
+    double Params::*d;
+} fields[] = {
+        {"pop_size",  &Params::pop_size,  nullptr},
+        {"triangles", &Params::triangles, nullptr},
+        {"mesh",      &Params::mesh,      nullptr},
+        {"shapes",    &Params::shapes,    nullptr},
+        {"opacity",   nullptr,            &Params::opacity},
+        {"raster",    &Params::raster,    nullptr},
+        {"metric",    &Params::metric,    nullptr},
+        {"elite",     nullptr,            &Params::elite},
+        {"crossover", nullptr,            &Params::crossover},
+        {"one_point", nullptr,            &Params::one_point},
+        {"disturb",   nullptr,            &Params::disturb},
+        {"adaptive",  &Params::adaptive,  nullptr},
+        {"threads",   &Params::threads,   nullptr},
+        {"staleness", &Params::staleness, nullptr},
+        {"strength",  nullptr,            &Params::strength},
+        {"detail",    nullptr,            &Params::detail},
+        {"status_every", &Params::status_every, nullptr},
+        {"export_every", &Params::export_every, nullptr},
+};
+
+bool set_param(Params &p, const char *key, const char *value) {
+    for (auto &f : fields) {
+        if (strcmp(f.name, key) != 0) continue;
+        if (f.i) p.*f.i = atoi(value);
+        else p.*f.d = atof(value);
+        clamp_params(p);
+        return true;
+    }
+    return false;
+}
+
+bool set_param(Params &p, const char *assignment) {
+    char key[64], value[64];
+    if (sscanf(assignment, " %63[^= \t] = %63s", key, value) != 2) return false;
+    return set_param(p, key, value);
+}
+
+bool load_params(const char *filename, Params &p) {
+    FILE *in = fopen(filename, "r");
+    if (!in) return false;
+    char line[256];
+    bool ok = true;
+    while (fgets(line, sizeof(line), in)) {
+        char *comment = strchr(line, '#');
+        if (comment) *comment = 0;
+        char key[64];
+        if (sscanf(line, " %63[^= \t\n]", key) != 1) continue; // blank line
+        if (!set_param(p, line)) {
+            fprintf(stderr, "%s: bad line: %s\n", filename, line);
+            ok = false;
+        }
+    }
+    fclose(in);
+    return ok;
+}
+
+void save_params(FILE *out, const Params &p) {
+    for (auto &f : fields) {
+        if (f.i) fprintf(out, "%s = %d\n", f.name, p.*f.i);
+        else fprintf(out, "%s = %g\n", f.name, p.*f.d);
+    }
+}
+
+void clamp_params(Params &p) {
+    p.pop_size = std::min(POP_SIZE, std::max(4, p.pop_size));
+    p.triangles = std::min(N, std::max(1, p.triangles));
+    p.mesh = p.mesh != 0;
+    p.shapes &= (1 << SHAPE_COUNT) - 1;
+    if (!p.shapes) p.shapes = 1 << SHAPE_TRIANGLE;
+    p.opacity = std::min(1.0, std::max(0.01, p.opacity));
+    p.raster = std::min(RASTER_COUNT - 1, std::max(0, p.raster));
+    p.metric = std::min(METRIC_COUNT - 1, std::max(0, p.metric));
+    p.elite = std::min(0.9, std::max(0.01, p.elite));
+    p.crossover = std::min(1.0, std::max(0.0, p.crossover));
+    p.one_point = std::min(1.0, std::max(0.0, p.one_point));
+    p.disturb = std::min(1.0, std::max(0.0, p.disturb));
+    p.adaptive = p.adaptive != 0;
+    p.threads = std::max(-1, p.threads);
+    p.staleness = std::min(POP_SIZE, std::max(0, p.staleness));
+    p.strength = std::min(100.0, std::max(0.01, p.strength));
+    p.detail = std::min(1.0, std::max(0.0, p.detail));
+    p.status_every = std::max(1, p.status_every);
+    p.export_every = std::max(0, p.export_every);
+}
@@ -0,0 +1,50 @@
+/*
+ * Runtime configuration
+ * The macros of chromosome.h give the defaults and the capacities (POP_SIZE, N), the values below are what a run uses.
+ * A configuration is a text file of "key = value" lines, '#' starts a comment.
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <cstdio>
+
+struct Params {
+    int pop_size;     // chromosomes in the population, at most POP_SIZE
+    int triangles;    // triangles (or other primitives) per chromosome, at most N
+    int mesh;         // 1 for the shared-vertex mesh genome (triangles only), see Chromosome
+    int shapes;       // primitive types in use, a bit per Shape (see raster.h): 1 triangles, 2 ellipses, 4 circles, 8 quads
+    double opacity;   // alpha channel value for triangles
+    int raster;       // rasterizer policy of the fitness engine, see engine.h (0 scalar, 1 fixed point)
+    int metric;       // metric policy of the fitness engine (0 squared error, 1 channel weighted squared error, 2 SAD)
+    double elite;     // fraction of the population advancing to the next generation without modification
+    double crossover; // initial operator mix: share of crossover,
+    double one_point; // share of one-point among crossovers
+    double disturb;   // and share of disturb among mutations
+    int adaptive;     // 1 to adapt the operator mix online, 0 to keep it fixed
+    int threads;      // background workers (polish or annealing chains), -1 for one per spare core
+    int staleness;    // children still being scored when the next generation starts breeding, 0 for a strict barrier
+    double strength;  // multiplies the disturbance of disturb mutations
+    double detail;    // share of the primitives placed by the detail of the image (see detail.h), 0 for uniformly
+    int status_every; // generations between two status lines
+    int export_every; // generations between two exports of the best chromosome to the output image, 0 for never
+};
+
+extern Params params;
+
+// Sets one parameter from its text value, returns false on an unknown key
+bool set_param(Params &p, const char *key, const char *value);
+
+// Parses "key=value" (as given on the command line)
+bool set_param(Params &p, const char *assignment);
+
+// Reads a configuration file over p, returns false if it cannot be read or has an unknown key
+bool load_params(const char *filename, Params &p);
+
+// Writes every parameter of p in the configuration file format
+void save_params(FILE *out, const Params &p);
+
+// Brings every parameter back into its valid range
+void clamp_params(Params &p);
+
+#endif // CONFIG_H
@@ -0,0 +1,137 @@
+/*
+ * Content-aware placement of the primitives, see detail.h
+ */
+
+#include "detail.h"
+#include "chromosome.h"
+#include <atomic>
+#include <algorithm>
+
+#define CELLS (DETAIL_CELLS * DETAIL_CELLS)
+
+// The weights are double buffered: breeding threads sample the current map while the main thread fills the other
+struct DetailMap {
+    double share[CELLS]; // sums to 1
+    double cdf[CELLS];
+};
+
+static DetailMap maps[2];
+static std::atomic<int> current(-1); // map in use, -1 before the first detail_update
+
+// Gradient energy of the input image, kept until the image changes
+static double gradient[CELLS];
+static const unsigned char *gradient_of = nullptr;
+static long gradient_w = 0, gradient_h = 0;
+
+static int cell_of(long x, long y, long w, long h) {
+    return (int) (y * DETAIL_CELLS / h) * DETAIL_CELLS + (int) (x * DETAIL_CELLS / w);
+}
+
+// Scales v to sum to 1 (evenly when it is all 0)
+static void normalize(double *v) {
+    double sum = 0;
+    for (int i = 0; i < CELLS; i++) sum += v[i];
+    for (int i = 0; i < CELLS; i++) v[i] = sum > 0 ? v[i] / sum : 1.0 / CELLS;
+}
+
+void detail_update(const unsigned char *best) {
+    long w = input.width, h = input.height;
+    const unsigned char *in = input.pixel;
+    if (in != gradient_of || w != gradient_w || h != gradient_h) {
+        memset(gradient, 0, sizeof(gradient));
+        for (long y = 0; y + 1 < h; y++) {
+            for (long x = 0; x + 1 < w; x++) {
+                const unsigned char *p = in + (y * w + x) * channels;
+                double e = 0;
+                for (int k = 0; k < channels; k++)
+                    e += abs(p[k] - p[k + channels]) + abs(p[k] - p[k + w * channels]);
+                gradient[cell_of(x, y, w, h)] += e;
+            }
+        }
+        normalize(gradient);
+        gradient_of = in;
+        gradient_w = w;
+        gradient_h = h;
+    }
+
+    double residual[CELLS] = {};
+    if (best) {
+        for (long y = 0; y < h; y++) {
+            for (long x = 0; x < w; x++) {
+                long off = (y * w + x) * channels;
+                double e = 0;
+                for (int k = 0; k < channels; k++) e += abs(best[off + k] - in[off + k]);
+                residual[cell_of(x, y, w, h)] += e;
+            }
+        }
+        normalize(residual);
+    }
+
+    int next = current.load(std::memory_order_relaxed) == 0 ? 1 : 0;
+    DetailMap &m = maps[next];
+    double r = best ? DETAIL_RESIDUAL : 0, sum = 0;
+    for (int i = 0; i < CELLS; i++) {
+        m.share[i] = DETAIL_FLOOR / CELLS + (1 - DETAIL_FLOOR) * ((1 - r) * gradient[i] + r * residual[i]);
+        m.cdf[i] = sum += m.share[i];
+    }
+    m.cdf[CELLS - 1] = 1;
+    current.store(next, std::memory_order_release);
+}
+
+bool detail_point(double &x, double &y, double &spread) {
+    int m = current.load(std::memory_order_acquire);
+    if (m < 0 || params.detail <= 0 || U_RND >= params.detail) return false;
+    const DetailMap &map = maps[m];
+    int i = std::min(CELLS - 1, (int) (std::upper_bound(map.cdf, map.cdf + CELLS, U_RND) - map.cdf));
+    x = (i % DETAIL_CELLS + U_RND) / DETAIL_CELLS;
+    y = (i / DETAIL_CELLS + U_RND) / DETAIL_CELLS;
+    spread = std::min(0.5, std::max(0.5 / DETAIL_CELLS, DETAIL_SIZE / sqrt(map.share[i] * CELLS)));
+    return true;
+}
+
+bool detail_place(double p[3][2]) {
+    double cx, cy, spread;
+    if (!detail_point(cx, cy, spread)) return false;
+    for (int k = 0; k < 3; k++) {
+        p[k][0] = std::min(1.0, std::max(0.0, cx + spread * RND));
+        p[k][1] = std::min(1.0, std::max(0.0, cy + spread * RND));
+    }
+    return true;
+}
+
+void detail_bias(const double (*point)[3][2], const unsigned char *shape, int n, double *bias) {
+    int m = current.load(std::memory_order_acquire);
+    if (m < 0 || params.detail <= 0) {
+        for (int t = 0; t < n; t++) bias[t] = 1;
+        return;
+    }
+
+    // Cell of every primitive, by its center
+    int cell[N], count[CELLS] = {};
+    for (int t = 0; t < n; t++) {
+        const double (*p)[2] = point[t];
+        double x, y;
+        if (shape[t] == SHAPE_TRIANGLE) {
+            x = (p[0][0] + p[1][0] + p[2][0]) / 3;
+            y = (p[0][1] + p[1][1] + p[2][1]) / 3;
+        } else if (shape[t] == SHAPE_QUAD) {
+            x = (p[1][0] + p[2][0]) / 2;
+            y = (p[1][1] + p[2][1]) / 2;
+        } else {
+            x = p[0][0];
+            y = p[0][1];
+        }
+        int cx = std::min(DETAIL_CELLS - 1, std::max(0, (int) (x * DETAIL_CELLS)));
+        int cy = std::min(DETAIL_CELLS - 1, std::max(0, (int) (y * DETAIL_CELLS)));
+        count[cell[t] = cy * DETAIL_CELLS + cx]++;
+    }
+
+    // Primitives over budget, blended with params.detail into the uniform chance
+    double sum = 0;
+    for (int t = 0; t < n; t++) {
+        double surplus = count[cell[t]] / (n * maps[m].share[cell[t]]);
+        bias[t] = std::min(4.0, std::max(0.25, surplus));
+        sum += bias[t];
+    }
+    for (int t = 0; t < n; t++) bias[t] = 1 - params.detail + params.detail * bias[t] * n / sum;
+}
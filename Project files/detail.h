@@ -0,0 +1,35 @@
+/*
+ * Content-aware placement of the primitives
+ * The canvas is split into DETAIL_CELLS x DETAIL_CELLS cells, weighted by the detail they hold: the gradient energy of
+ * the input image, mixed with the error the best chromosome still makes there. Primitives placed from scratch (the
+ * initial population, mutate_change and the plateau re-seeding) land by these weights, with chance params.detail,
+ * and are sized to the density of their cell. The re-seeding also takes primitives preferably from cells holding more
+ * than their share of params.triangles. Detailed regions thus get more of the fixed budget, and flat ones make do with
+ * a few large primitives.
+ */
+
+#ifndef DETAIL_H
+#define DETAIL_H
+
+#define DETAIL_CELLS 16     // Cells per side
+#define DETAIL_REFRESH 10   // Generations between two updates of the residual error
+#define DETAIL_RESIDUAL 0.5 // Weight of the residual error against the gradient energy
+#define DETAIL_FLOOR 0.05   // Share of the weight spread evenly, so that no cell is starved entirely
+#define DETAIL_SIZE 0.25    // Spread of a primitive placed in a cell of average weight (shrinks with the weight)
+
+// Weights the cells by the current input image and best, the render of the best chromosome (nullptr before there is
+// one); the gradients are only computed again when the input image changed
+void detail_update(const unsigned char *best);
+
+// With chance params.detail (and once detail_update was called), picks a point by the weights and the spread of a
+// primitive there; otherwise returns false, without drawing a random number if params.detail is 0
+bool detail_point(double &x, double &y, double &spread);
+
+// Places the points of a primitive around a point picked by detail_point, returns false (leaving p alone) if none was
+bool detail_place(double p[3][2]);
+
+// Chance of every one of the n primitives to be re-placed, relative to the average: above 1 in cells holding more
+// primitives than their share, below 1 in the others
+void detail_bias(const double (*point)[3][2], const unsigned char *shape, int n, double *bias);
+
+#endif // DETAIL_H
@@ -0,0 +1,354 @@
+/*
+ * Policy-based fitness engine, see engine.h
+ * A pixel is covered by a triangle when its center lies inside (or on the border of) the triangle.
+ */
+
+#include "engine.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+const char *raster_names[RASTER_COUNT] = {"scalar", "fixed"};
+const char *metric_names[METRIC_COUNT] = {"sse", "weighted", "sad"};
+
+// Rasterizer policy, for convex polygons of K vertices (triangles and quads): setup() takes the vertices in
+// normalized coordinates, in either winding (false if the polygon covers nothing), span() gives the covered pixels
+// [sx, fx] of row py, clipped to the pixel centers of [x0, x1) (false if there are none)
+template<int K>
+struct ScalarRaster {
+    double x[K], y[K];
+
+    bool setup(const double (*p)[2], int w, int h) {
+        for (int i = 0; i < K; i++) {
+            x[i] = p[i][0] * w;
+            y[i] = p[i][1] * h;
+        }
+
+        // Make the winding counter-clockwise so that "inside" is the left side of every edge
+        double area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (area == 0) return false;
+        if (area < 0) {
+            for (int i = 1; i <= K / 2; i++) {
+                std::swap(x[i], x[K - i]);
+                std::swap(y[i], y[K - i]);
+            }
+        }
+        return true;
+    }
+
+    bool span(int py, int x0, int x1, int &sx, int &fx) const {
+        double cy = py + 0.5;
+
+        // Intersect the scanline with the K half-planes to get the covered span [lo, hi]
+        double lo = x0 + 0.5, hi = x1 - 0.5;
+        for (int i = 0; i < K; i++) {
+            int j = (i + 1) % K;
+            double ex = x[j] - x[i], ey = y[j] - y[i];
+            if (ey == 0) {
+                if (ex * (cy - y[i]) < 0) return false;
+                continue;
+            }
+            double xe = x[i] + ex * (cy - y[i]) / ey;
+            if (ey > 0) hi = std::min(hi, xe);
+            else lo = std::max(lo, xe);
+        }
+        if (lo > hi) return false;
+        sx = (int) ceil(lo - 0.5);
+        fx = (int) floor(hi - 0.5);
+        return sx <= fx;
+    }
+};
+
+#define FIXED_ONE 256 // 24.8 fixed point
+#define FIXED_HALF 128
+
+static inline ll floor_div(ll a, ll b) { return a / b - ((a % b != 0) && ((a < 0) != (b < 0))); }
+
+static inline ll ceil_div(ll a, ll b) { return -floor_div(-a, b); }
+
+template<int K>
+struct FixedRaster {
+    ll x[K], y[K];
+
+    bool setup(const double (*p)[2], int w, int h) {
+        for (int i = 0; i < K; i++) {
+            x[i] = llround(p[i][0] * w * FIXED_ONE);
+            y[i] = llround(p[i][1] * h * FIXED_ONE);
+        }
+        ll area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (area == 0) return false;
+        if (area < 0) {
+            for (int i = 1; i <= K / 2; i++) {
+                std::swap(x[i], x[K - i]);
+                std::swap(y[i], y[K - i]);
+            }
+        }
+        return true;
+    }
+
+    bool span(int py, int x0, int x1, int &sx, int &fx) const {
+        ll cy = (ll) py * FIXED_ONE + FIXED_HALF;
+        ll lo = (ll) x0 * FIXED_ONE + FIXED_HALF, hi = (ll) (x1 - 1) * FIXED_ONE + FIXED_HALF;
+        for (int i = 0; i < K; i++) {
+            int j = (i + 1) % K;
+            ll ex = x[j] - x[i], ey = y[j] - y[i];
+            if (ey == 0) {
+                if (ex * (cy - y[i]) < 0) return false;
+                continue;
+            }
+            // Rounded towards the inside of the edge, so a center exactly on it is covered
+            if (ey > 0) hi = std::min(hi, x[i] + floor_div(ex * (cy - y[i]), ey));
+            else lo = std::max(lo, x[i] + ceil_div(ex * (cy - y[i]), ey));
+        }
+        if (lo > hi) return false;
+        sx = (int) ceil_div(lo - FIXED_HALF, FIXED_ONE);
+        fx = (int) floor_div(hi - FIXED_HALF, FIXED_ONE);
+        return sx <= fx;
+    }
+};
+
+// Spans of an axis-aligned ellipse (or circle), one square root per row, shared by every rasterizer policy
+// Encoded like shape_bounds() in raster.cpp: center p[0], radii from p[1], p[2] unused
+struct EllipseSpans {
+    double cx, cy, rx, ry;
+
+    bool setup(const double p[3][2], bool circle, int w, int h) {
+        cx = p[0][0] * w;
+        cy = p[0][1] * h;
+        rx = fabs(p[1][0] - p[0][0]) * w;
+        ry = fabs(p[1][1] - p[0][1]) * h;
+        if (circle) rx = ry = hypot(rx, ry);
+        return rx > 0 && ry > 0;
+    }
+
+    bool span(int py, int x0, int x1, int &sx, int &fx) const {
+        double dy = (py + 0.5 - cy) / ry;
+        if (dy * dy > 1) return false;
+        double half = rx * sqrt(1 - dy * dy);
+        double lo = std::max(x0 + 0.5, cx - half), hi = std::min(x1 - 0.5, cx + half);
+        if (lo > hi) return false;
+        sx = (int) ceil(lo - 0.5);
+        fx = (int) floor(hi - 0.5);
+        return sx <= fx;
+    }
+};
+
+// Kernels of the metrics, multiversioned (see raster.h), n is in bytes
+MULTIVERSION static ll sse_row(const unsigned char *a, const unsigned char *b, int n) {
+    int err = 0;
+    for (int i = 0; i < n; i++) err += (a[i] - b[i]) * (a[i] - b[i]);
+    return err;
+}
+
+MULTIVERSION static ll weighted_row(const unsigned char *a, const unsigned char *b, int n) {
+    ll err = 0;
+    for (int i = 0; i < n; i += 3) {
+        int dr = a[i] - b[i], dg = a[i + 1] - b[i + 1], db = a[i + 2] - b[i + 2];
+        err += 2 * dr * dr + 4 * dg * dg + 3 * db * db;
+    }
+    return err;
+}
+
+// Sum of absolute differences of n bytes, generic version (also does the tails of the vector ones)
+static ll sad_bytes(const unsigned char *a, const unsigned char *b, int n) {
+    int err = 0;
+    for (int i = 0; i < n; i++) err += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+    return err;
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+// psadbw adds up the absolute differences of 8 bytes into a 64-bit lane, so a row needs no widening at all.
+// One version per vector width, the best one the CPU supports is picked once (a hand-rolled ifunc)
+static ll sad_row_sse2(const unsigned char *a, const unsigned char *b, int n) {
+    __m128i acc = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *) (a + i)),
+                                              _mm_loadu_si128((const __m128i *) (b + i))));
+    return _mm_cvtsi128_si64(acc) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(acc, acc)) + sad_bytes(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2"))) static ll sad_row_avx2(const unsigned char *a, const unsigned char *b, int n) {
+    __m256i acc = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 32 <= n; i += 32)
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i *) (a + i)),
+                                                    _mm256_loadu_si256((const __m256i *) (b + i))));
+    __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    return _mm_cvtsi128_si64(sum) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(sum, sum)) + sad_bytes(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx512bw"))) static ll sad_row_avx512(const unsigned char *a, const unsigned char *b, int n) {
+    __m512i acc = _mm512_setzero_si512();
+    int i = 0;
+    for (; i + 64 <= n; i += 64)
+        acc = _mm512_add_epi64(acc, _mm512_sad_epu8(_mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i)));
+    return _mm512_reduce_add_epi64(acc) + sad_bytes(a + i, b + i, n - i);
+}
+
+static ll (*pick_sad())(const unsigned char *, const unsigned char *, int) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) return sad_row_avx512;
+    if (__builtin_cpu_supports("avx2")) return sad_row_avx2;
+    return sad_row_sse2;
+}
+
+static ll (*const sad_row)(const unsigned char *, const unsigned char *, int) = pick_sad();
+#else
+#define sad_row sad_bytes
+#endif
+
+// Metric policy: row<C>() is the error of n pixels of C channels of buf against the target
+struct SseMetric {
+    template<int C>
+    static ll row(const unsigned char *a, const unsigned char *b, int n) { return sse_row(a, b, n * C); }
+};
+
+struct WeightedMetric {
+    // The weights add up to 9 for a gray pixel
+    template<int C>
+    static ll row(const unsigned char *a, const unsigned char *b, int n) {
+        return C == 1 ? 9 * sse_row(a, b, n) : weighted_row(a, b, n * C);
+    }
+};
+
+struct SadMetric {
+    template<int C>
+    static ll row(const unsigned char *a, const unsigned char *b, int n) { return sad_row(a, b, n * C); }
+};
+
+// Blends n pixels of color s (premultiplied, see triangle()) into d
+MULTIVERSION static void blend_span(unsigned char *d, int n, const int s[3], int ia) {
+    for (int i = 0; i < n; i++, d += 3) {
+        d[0] = (unsigned char) ((d[0] * ia + s[0]) / 255);
+        d[1] = (unsigned char) ((d[1] * ia + s[1]) / 255);
+        d[2] = (unsigned char) ((d[2] * ia + s[2]) / 255);
+    }
+}
+
+MULTIVERSION static void blend_span_gray(unsigned char *d, int n, int s, int ia) {
+    for (int i = 0; i < n; i++) d[i] = (unsigned char) ((d[i] * ia + s) / 255);
+}
+
+// Primitives met in the current band of a render with a grid, one bit each (see Engine::render)
+static thread_local unsigned long long band_mark[GRID_MAX_PRIMITIVES / 64];
+
+// C is the number of channels of the buffers (see channels in raster.h), a grayscale engine only blends color[0]
+template<template<int> class Raster, class Metric, int C>
+struct Engine {
+    // Blends the spans of t over rows [y0, y1) into buf
+    // The span setup is not multiversioned: it is a few scalar divisions per row, which wider vectors do not speed up
+    // (measured with --bench), and the FMA of the newer targets could move an edge pixel between builds
+    template<class Spans>
+    static inline void fill(const Spans &t, int x0, int x1, int y0, int y1, unsigned char *buf, int w,
+                            const int s[C], int ia) {
+        for (int py = y0; py < y1; py++) {
+            int sx, fx;
+            if (!t.span(py, x0, x1, sx, fx)) continue;
+            if (C == 1) blend_span_gray(buf + (ll) py * w + sx, fx - sx + 1, s[0], ia);
+            else blend_span(buf + ((ll) py * w + sx) * C, fx - sx + 1, s, ia);
+        }
+    }
+
+    // Blends one primitive into buf, clipped to r
+    static inline void primitive(const double p[3][2], int shape, const double c[4], unsigned char *buf, int w, int h,
+                                 const Rect &r) {
+        Rect b = shape_bounds(p, shape, w, h);
+        int x0 = std::max(b.x0, r.x0), x1 = std::min(b.x1, r.x1);
+        int y0 = std::max(b.y0, r.y0), y1 = std::min(b.y1, r.y1);
+        if (x0 >= x1 || y0 >= y1) return;
+
+        // Source color premultiplied by alpha (with the rounding term folded in), as 8-bit integers
+        int a = (int) (std::min(std::max(c[3], 0.0), 1.0) * 255 + 0.5);
+        int ia = 255 - a;
+        int s[C];
+        for (int k = 0; k < C; k++) s[k] = (int) (std::min(std::max(c[k], 0.0), 1.0) * 255 + 0.5) * a + 127;
+
+        if (shape == SHAPE_ELLIPSE || shape == SHAPE_CIRCLE) {
+            EllipseSpans e;
+            if (e.setup(p, shape == SHAPE_CIRCLE, w, h)) fill(e, x0, x1, y0, y1, buf, w, s, ia);
+        } else if (shape == SHAPE_QUAD) {
+            const double q[4][2] = {{p[0][0], p[0][1]}, {p[1][0], p[1][1]},
+                                    {p[1][0] + p[2][0] - p[0][0], p[1][1] + p[2][1] - p[0][1]}, {p[2][0], p[2][1]}};
+            Raster<4> t;
+            if (t.setup(q, w, h)) fill(t, x0, x1, y0, y1, buf, w, s, ia);
+        } else {
+            Raster<3> t;
+            if (t.setup(p, w, h)) fill(t, x0, x1, y0, y1, buf, w, s, ia);
+        }
+    }
+
+    static void render(const double (*point)[3][2], const unsigned char *shape, const double (*color)[4], int n,
+                       unsigned char *buf, int w, int h, const Rect &r, const Grid *grid) {
+        if (r.empty()) return;
+        for (int y = r.y0; y < r.y1; y++) memset(buf + ((ll) y * w + r.x0) * C, 0, (r.x1 - r.x0) * C);
+        if (!grid) {
+            for (int i = 0; i < n; i++) primitive(point[i], shape[i], color[i], buf, w, h, r);
+            return;
+        }
+
+        // Band of cells by band of cells: the primitives listed in the cells of r there, each once and in order
+        int cx0, cy0, cx1, cy1, words = (n + 63) / 64;
+        grid_cells(r, w, h, cx0, cy0, cx1, cy1);
+        for (int cy = cy0; cy <= cy1; cy++) {
+            Rect band = grid_band(cy, w, h);
+            band = {r.x0, std::max(r.y0, band.y0), r.x1, std::min(r.y1, band.y1)};
+            memset(band_mark, 0, sizeof(band_mark[0]) * words);
+            for (int cx = cx0; cx <= cx1; cx++) {
+                const unsigned short *l = grid->list(cy * GRID + cx);
+                for (unsigned int k = 0; k < grid->count[cy * GRID + cx]; k++)
+                    if (l[k] < n) band_mark[l[k] / 64] |= 1ULL << (l[k] % 64);
+            }
+            for (int k = 0; k < words; k++)
+                for (unsigned long long bits = band_mark[k]; bits; bits &= bits - 1) {
+                    int i = k * 64 + __builtin_ctzll(bits);
+                    primitive(point[i], shape[i], color[i], buf, w, h, band);
+                }
+        }
+    }
+
+    static ll error(const unsigned char *buf, const unsigned char *target, int w, const Rect &r) {
+        ll err = 0;
+        for (int y = r.y0; y < r.y1; y++) {
+            ll off = ((ll) y * w + r.x0) * C;
+            err += Metric::template row<C>(buf + off, target + off, r.x1 - r.x0);
+        }
+        return err;
+    }
+};
+
+// Grayscale and RGB instantiation of a combination
+#define ENGINE(R, M) {{Engine<R, M, 1>::render, Engine<R, M, 1>::error}, {Engine<R, M, 3>::render, Engine<R, M, 3>::error}}
+
+static const EngineOps engines[RASTER_COUNT][METRIC_COUNT][2] = {
+        {ENGINE(ScalarRaster, SseMetric), ENGINE(ScalarRaster, WeightedMetric), ENGINE(ScalarRaster, SadMetric)},
+        {ENGINE(FixedRaster, SseMetric),  ENGINE(FixedRaster, WeightedMetric),  ENGINE(FixedRaster, SadMetric)},
+};
+
+static EngineOps engine = engines[RASTER_SCALAR][METRIC_SSE][1];
+
+const EngineOps *engine_get(int raster, int metric) {
+    if (raster < 0 || raster >= RASTER_COUNT || metric < 0 || metric >= METRIC_COUNT) return nullptr;
+    return &engines[raster][metric][channels == 3];
+}
+
+bool engine_select(int raster, int metric, int bytes_per_pixel) {
+    if (bytes_per_pixel != 1 && bytes_per_pixel != 3) return false;
+    channels = bytes_per_pixel;
+    const EngineOps *e = engine_get(raster, metric);
+    if (!e) return false;
+    engine = *e;
+    return true;
+}
+
+void render_rect(const double (*point)[3][2], const unsigned char *shape, const double (*color)[4], int n,
+                 unsigned char *buf, int w, int h, const Rect &r, const Grid *grid) {
+    engine.render(point, shape, color, n, buf, w, h, r, grid);
+}
+
+ll rect_error(const unsigned char *buf, const unsigned char *target, int w, const Rect &r) {
+    return engine.error(buf, target, w, r);
+}
@@ -0,0 +1,49 @@
+/*
+ * Policy-based fitness engine
+ * The render and score loops of the software rasterizer are a template over two policies: the rasterizer (how a
+ * triangle or quad becomes pixel spans) and the metric (how the difference of a row of pixels to the target is weighed).
+ * Every combination is instantiated with its policies inlined, once for RGB and once for single channel (grayscale)
+ * buffers, and engine_select picks one at startup; render_rect and rect_error (see raster.h) then go through it,
+ * which costs one indirect call per rectangle, never per triangle or per pixel.
+ *
+ * Adding a policy: write a struct with the interface of ScalarRaster or SseMetric in engine.cpp, add its enum value
+ * below, its name, and a row or column to the engines table.
+ */
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "raster.h"
+
+enum RasterPolicy {
+    RASTER_SCALAR, // double precision edge intersection per scanline (ellipses always use their own span setup)
+    RASTER_FIXED,  // the same in 24.8 fixed point, integer only
+    RASTER_COUNT
+};
+
+enum MetricPolicy {
+    METRIC_SSE,      // sum of squared differences
+    METRIC_WEIGHTED, // squared differences weighted per channel like the eye (2R + 4G + 3B)
+    METRIC_SAD,      // sum of absolute differences (L1), one psadbw per 16 to 64 bytes, the cheapest to evaluate
+    METRIC_COUNT
+};
+
+extern const char *raster_names[RASTER_COUNT];
+extern const char *metric_names[METRIC_COUNT];
+
+// Entry points of one instantiated engine, same contracts as render_rect and rect_error
+struct EngineOps {
+    void (*render)(const double (*point)[3][2], const unsigned char *shape, const double (*color)[4], int n,
+                   unsigned char *buf, int w, int h, const Rect &r, const Grid *grid);
+    ll (*error)(const unsigned char *buf, const unsigned char *target, int w, const Rect &r);
+};
+
+// Engine of a combination of policies for the current channels, nullptr if out of range
+const EngineOps *engine_get(int raster, int metric);
+
+// Makes a combination the one used by render_rect and rect_error, for buffers of the given bytes per pixel (3 for
+// RGB, 1 for grayscale, which also sets channels), returns false if out of range. Must be called before any buffer
+// is allocated or anything is scored, fitness values of different engines cannot be compared
+bool engine_select(int raster, int metric, int bytes_per_pixel);
+
+#endif // ENGINE_H
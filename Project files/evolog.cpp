@@ -0,0 +1,199 @@
+/*
+ * Evolution log and replay, see evolog.h
+ * The file is a LogHeader, then entries: a LogEntry followed by its LogTriangles. An entry listing every triangle is
+ * a keyframe (the first one always is).
+ */
+
+#include "evolog.h"
+#include "engine.h"
+#include "anytime.h"
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+#define LOG_MAGIC 0x474c4147 // "GALG"
+
+struct LogHeader {
+    unsigned int magic;
+    int triangles, width, height, channels;
+};
+
+struct LogEntry {
+    int epoch, changed; // changed: number of LogTriangles that follow
+    ll fit;
+};
+
+struct LogTriangle {
+    unsigned short index;
+    unsigned char shape, unused;
+    float point[V][2], color[4];
+};
+
+// Writer: the file and what its last entry left the best chromosome at
+static FILE *log_file = nullptr;
+static LogTriangle logged[N], diff[N];
+static ll logged_fit = -1;
+static int entries = 0;
+
+bool evolog_open(const char *path) {
+    log_file = fopen(path, "wb");
+    if (!log_file) {
+        fprintf(stderr, "Cannot write the log %s\n", path);
+        return false;
+    }
+    LogHeader h = {LOG_MAGIC, params.triangles, (int) input.width, (int) input.height, channels};
+    fwrite(&h, sizeof(h), 1, log_file);
+    memset(logged, 0, sizeof(logged));
+    logged_fit = -1;
+    entries = 0;
+    return true;
+}
+
+void evolog_record(int epoch, const Chromosome &best) {
+    if (!log_file || best.fit_val == logged_fit) return;
+    bool keyframe = entries % LOG_KEYFRAME == 0;
+    int n = 0;
+    for (int t = 0; t < params.triangles; t++) {
+        LogTriangle now{};
+        now.index = (unsigned short) t;
+        now.shape = best.shape[t];
+        for (int k = 0; k < V; k++) {
+            now.point[k][0] = best.point[t][k][0];
+            now.point[k][1] = best.point[t][k][1];
+        }
+        for (int k = 0; k < 4; k++) now.color[k] = best.color[t][k];
+        if (keyframe || memcmp(&now, &logged[t], sizeof(now)) != 0) logged[t] = diff[n++] = now;
+    }
+    LogEntry e = {epoch, n, best.fit_val};
+    fwrite(&e, sizeof(e), 1, log_file);
+    fwrite(diff, sizeof(diff[0]), n, log_file);
+    fflush(log_file); // a log is worth something even if the run is killed
+    logged_fit = best.fit_val;
+    entries++;
+}
+
+void evolog_close() {
+    if (log_file) fclose(log_file);
+    log_file = nullptr;
+}
+
+// Where an entry is, and the keyframe it builds on
+struct LogIndex {
+    int epoch, changed;
+    long offset; // of its triangles
+    int keyframe;
+};
+
+// Number of frame number conversions in the output pattern (%d, with flags and width such as %04d), -1 if it holds
+// any other conversion: the pattern comes from the command line and is given a single int
+static int frame_conversions(const char *output) {
+    int n = 0;
+    for (const char *c = output; (c = strchr(c, '%')); c++) {
+        if (c[1] == '%') {
+            c++;
+            continue;
+        }
+        c += 1 + strspn(c + 1, "-+ 0");
+        c += strspn(c, "0123456789");
+        if (*c != 'd' && *c != 'i') return -1;
+        n++;
+    }
+    return n;
+}
+
+// Renders frames taken from a shared counter, each from the keyframe before it
+static void replay_worker(const char *path, const LogHeader &h, const std::vector<LogIndex> &index,
+                          const std::vector<int> &epochs, const char *output, std::atomic<int> &next,
+                          std::atomic<int> &failed) {
+    FILE *f = fopen(path, "rb");
+    auto *point = new double[N][V][2]();
+    auto *color = new double[N][4]();
+    auto *shape = new unsigned char[N]();
+    auto *buf = new unsigned char[(size_t) h.width * h.height * h.channels];
+    std::vector<LogTriangle> tris(h.triangles);
+    for (int i; f && (i = next++) < (int) epochs.size();) {
+        // Last entry at or before the epoch of the frame
+        auto it = std::upper_bound(index.begin(), index.end(), epochs[i],
+                                   [](int e, const LogIndex &x) { return e < x.epoch; });
+        int last = (int) (it - index.begin()) - 1;
+        for (int j = last < 0 ? 0 : index[last].keyframe; j <= last; j++) {
+            const LogIndex &x = index[j];
+            if (fseek(f, x.offset, SEEK_SET) != 0 ||
+                fread(tris.data(), sizeof(LogTriangle), x.changed, f) != (size_t) x.changed) {
+                failed++;
+                break;
+            }
+            for (int k = 0; k < x.changed; k++) {
+                const LogTriangle &t = tris[k];
+                if (t.index >= h.triangles) continue;
+                shape[t.index] = t.shape;
+                for (int v = 0; v < V; v++) {
+                    point[t.index][v][0] = t.point[v][0];
+                    point[t.index][v][1] = t.point[v][1];
+                }
+                for (int c = 0; c < 4; c++) color[t.index][c] = t.color[c];
+            }
+        }
+        Rect all = {0, 0, h.width, h.height};
+        render_rect(point, shape, color, last < 0 ? 0 : h.triangles, buf, h.width, h.height, all);
+        char name[1024];
+        snprintf(name, sizeof(name), output, i);
+        if (!ImageReader::WriteBmpFile(name, buf, h.width, h.height, h.channels)) failed++;
+    }
+    if (f) fclose(f);
+    delete[] point;
+    delete[] color;
+    delete[] shape;
+    delete[] buf;
+}
+
+int evolog_replay(const char *path, int frames, int epoch, const char *output, int threads) {
+    FILE *f = fopen(path, "rb");
+    LogHeader h{};
+    if (!f || fread(&h, sizeof(h), 1, f) != 1 || h.magic != LOG_MAGIC || h.triangles <= 0 || h.triangles > N ||
+        (h.channels != 1 && h.channels != 3)) {
+        fprintf(stderr, "Cannot read the log %s\n", path);
+        if (f) fclose(f);
+        return 1;
+    }
+    int conversions = frame_conversions(output);
+    if (conversions < 0 || conversions > 1 || (frames > 1 && conversions == 0)) {
+        fprintf(stderr, "The output %s needs a single frame number pattern, such as frame%%04d.bmp\n", output);
+        fclose(f);
+        return 1;
+    }
+
+    // Only the entry headers are read here, the triangles are read by the workers
+    std::vector<LogIndex> index;
+    LogEntry e;
+    while (fread(&e, sizeof(e), 1, f) == 1 && e.changed >= 0 && e.changed <= h.triangles) {
+        int key = e.changed == h.triangles || index.empty() ? (int) index.size() : index.back().keyframe;
+        index.push_back({e.epoch, e.changed, ftell(f), key});
+        if (fseek(f, (long) e.changed * sizeof(LogTriangle), SEEK_CUR) != 0) break;
+    }
+    fclose(f);
+    if (index.empty()) {
+        fprintf(stderr, "The log %s has no entries\n", path);
+        return 1;
+    }
+
+    int first = index.front().epoch, last = index.back().epoch;
+    std::vector<int> epochs(std::max(1, frames));
+    for (int i = 0; i < (int) epochs.size(); i++)
+        epochs[i] = epochs.size() == 1 ? (epoch >= 0 ? epoch : last)
+                                       : first + (int) ((long) (last - first) * i / (epochs.size() - 1));
+
+    // Frames are rendered with the channels of the run that wrote the log
+    engine_select(params.raster, params.metric, h.channels);
+    double start = now_seconds();
+    std::atomic<int> next(0), failed(0);
+    std::vector<std::thread> pool;
+    for (int i = 0; i < std::max(1, threads); i++)
+        pool.emplace_back(replay_worker, path, std::cref(h), std::cref(index), std::cref(epochs), output,
+                          std::ref(next), std::ref(failed));
+    for (auto &t : pool) t.join();
+    printf("Replay: %zu entries over epochs %d to %d, %zu frames of %dx%d written in %.2fs\n", index.size(), first,
+           last, epochs.size(), h.width, h.height, now_seconds() - start);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,30 @@
+/*
+ * Evolution log and replay
+ * A run given --log appends every change of its best chromosome to a file: the epoch, the fitness and the triangles
+ * that differ from the previous entry (in floats, which is plenty for a picture). Every LOG_KEYFRAME entries, an entry
+ * lists all the triangles, so that any epoch can be rebuilt from the keyframe before it and a few diffs.
+ * --replay renders frames of such a log, spread evenly over the epochs, on every core at once (timelapses).
+ */
+
+#ifndef EVOLOG_H
+#define EVOLOG_H
+
+#include "chromosome.h"
+
+#define LOG_KEYFRAME 64 // Entries between two full copies of the best chromosome
+
+// Starts logging to path (replacing it), returns false if it cannot be written
+bool evolog_open(const char *path);
+
+// Logs best if it changed since the last entry (call once per generation)
+void evolog_record(int epoch, const Chromosome &best);
+
+// Closes the log, safe to call more than once
+void evolog_close();
+
+// Renders frames (evenly spaced epochs, the last one is the final state) of the log at path, using threads threads
+// With one frame, epoch (if not negative) picks the epoch to render instead
+// Files are named by output, a pattern with one %d for the frame number (frame%04d.bmp) or a plain name for one frame
+int evolog_replay(const char *path, int frames, int epoch, const char *output, int threads);
+
+#endif // EVOLOG_H
@@ -8,6 +8,7 @@
 bool ImageReader::LoadBmpFile(const char *filename) {
     Reset();
     FILE *infile = fopen(filename, "rb");
+    if (!infile) return false;
 
     int bChar = fgetc(infile);
     int mChar = fgetc(infile);
@@ -20,7 +21,8 @@ bool ImageReader::LoadBmpFile(const char *filename) {
         skipChars(infile, 4 + 4 + 4 + 4 + 4 + 4);
     }
 
-    pixel = new unsigned char[NumRows * GetNumBytesPerRow()];
+    // The rows of the file are padded to 4 bytes, the ones of pixel are not (see WriteBmpFile)
+    pixel = new unsigned char[NumRows * NumCols * 3];
 
     unsigned char *cPtr = pixel;
     for (int i = 0; i < NumRows; i++) {
@@ -31,17 +33,25 @@ bool ImageReader::LoadBmpFile(const char *filename) {
             *cPtr = fgetc(infile);
             cPtr += 3;
         }
-        int k = 3 * NumCols;
-        for (; k < GetNumBytesPerRow(); k++) {
-            fgetc(infile);
-            *(cPtr++) = 0;
-        }
+        skipChars(infile, GetNumBytesPerRow() - 3 * NumCols);
     }
 
     fclose(infile);
+    width = NumCols;
+    height = NumRows;
+    packGrayscale();
     return true;
 }
 
+// Grayscale images keep a single byte per pixel, so that rendering and scoring only do a third of the work
+void ImageReader::packGrayscale() {
+    long n = NumCols * NumRows;
+    for (long i = 0; i < n; i++)
+        if (pixel[i * 3] != pixel[i * 3 + 1] || pixel[i * 3] != pixel[i * 3 + 2]) return;
+    for (long i = 0; i < n; i++) pixel[i] = pixel[i * 3];
+    channels = 1;
+}
+
 short ImageReader::readShort(FILE *infile) {
     unsigned char lowByte, hiByte;
     lowByte = fgetc(infile);
@@ -75,3 +85,55 @@ void ImageReader::skipChars(FILE *infile, int numChars) {
         fgetc(infile);
     }
 }
+
+bool ImageReader::WriteBmpFile(const char *filename, const unsigned char *rgb, long width, long height, int channels) {
+    FILE *outfile = fopen(filename, "wb");
+    if (!outfile) return false;
+
+    long bytesPerRow = ((3 * width + 3) >> 2) << 2;
+    fputc('B', outfile);
+    fputc('M', outfile);
+    writeLong(outfile, 54 + bytesPerRow * height); // file size
+    writeShort(outfile, 0);
+    writeShort(outfile, 0);
+    writeLong(outfile, 54);                        // offset of the pixel data
+    writeLong(outfile, 40);                        // size of the info header
+    writeLong(outfile, width);
+    writeLong(outfile, height);
+    writeShort(outfile, 1);                        // planes
+    writeShort(outfile, 24);                       // bits per pixel
+    writeLong(outfile, 0);                         // no compression
+    writeLong(outfile, bytesPerRow * height);
+    writeLong(outfile, 2835);                      // 72 dpi
+    writeLong(outfile, 2835);
+    writeLong(outfile, 0);
+    writeLong(outfile, 0);
+
+    // A row at a time (the deadline of the anytime mode includes this write)
+    unsigned char *row = new unsigned char[bytesPerRow]();
+    bool ok = true;
+    for (long i = 0; i < height; i++) {
+        const unsigned char *cPtr = rgb + i * width * channels;
+        for (long j = 0; j < width; j++, cPtr += channels) {
+            row[3 * j] = cPtr[channels - 1];
+            row[3 * j + 1] = cPtr[channels / 2];
+            row[3 * j + 2] = cPtr[0];
+        }
+        ok = ok && fwrite(row, 1, bytesPerRow, outfile) == (size_t) bytesPerRow;
+    }
+    delete[] row;
+
+    return fclose(outfile) == 0 && ok;
+}
+
+void ImageReader::writeShort(FILE *outfile, short data) {
+    fputc(data & 0xff, outfile);
+    fputc((data >> 8) & 0xff, outfile);
+}
+
+void ImageReader::writeLong(FILE *outfile, long data) {
+    fputc(data & 0xff, outfile);
+    fputc((data >> 8) & 0xff, outfile);
+    fputc((data >> 16) & 0xff, outfile);
+    fputc((data >> 24) & 0xff, outfile);
+}
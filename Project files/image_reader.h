@@ -15,11 +15,16 @@ public:
 
     ImageReader(const char *filename);
 
-    unsigned char *pixel;
+    unsigned char *pixel; // tightly packed rows, bottom-up
     long height, width;
+    int channels; // bytes per pixel of pixel: 3 (RGB), or 1 when the image is grayscale (R = G = B everywhere)
 
     bool LoadBmpFile(const char *filename);
 
+    // Writes a tightly packed, bottom-up RGB (or, with channels = 1, gray) buffer (the layout of pixel) as a 24-bit BMP file
+    static bool WriteBmpFile(const char *filename, const unsigned char *rgb, long width, long height, int channels = 3);
+
+    // Bytes per row in the BMP file (padded to a multiple of 4)
     long GetNumBytesPerRow() const { return ((3 * NumCols + 3) >> 2) << 2; }
 
     void Reset();
@@ -34,8 +39,23 @@ private:
 
     static void skipChars(FILE *infile, int numChars);
 
+    void packGrayscale();
+
+    static void writeShort(FILE *outfile, short data);
+
+    static void writeLong(FILE *outfile, long data);
+
 };
 
+inline ImageReader::ImageReader() {
+    NumRows = 0;
+    NumCols = 0;
+    pixel = 0;
+    height = 0;
+    width = 0;
+    channels = 3;
+}
+
 inline ImageReader::ImageReader(const char *filename) {
     NumRows = 0;
     NumCols = 0;
@@ -51,6 +71,7 @@ inline void ImageReader::Reset() {
     NumCols = 0;
     delete[] pixel;
     pixel = 0;
+    channels = 3;
 }
 
 
@@ -0,0 +1,201 @@
+/*
+ * Warm-start library, see library.h
+ * The file is a sequence of records, each a LibraryRecord followed by the genome arrays it describes
+ */
+
+#include "library.h"
+#include "autotune.h"
+#include <algorithm>
+
+#define LIBRARY_MAGIC 0x4c425247 // "GRBL"
+
+struct LibraryRecord {
+    unsigned int magic;
+    int triangles, mesh, vertices; // vertices of the pool, 0 unless mesh
+    unsigned long long hash;
+    double error; // relative error the genome reached, see relative_error
+};
+
+// A usable record found by the lookup
+struct LibraryHit {
+    int distance;
+    double error;
+    long offset; // of the genome arrays in the file
+    LibraryRecord record;
+};
+
+static const char *library_path = nullptr;
+static unsigned long long input_hash = 0;
+
+unsigned long long image_hash(const unsigned char *pixel, long w, long h, int channels) {
+    // 9x8 thumbnail of the luminance, box filtered
+    double cell[8][9];
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 9; x++) {
+            long x0 = x * w / 9, x1 = std::max(x0 + 1, (x + 1) * w / 9);
+            long y0 = y * h / 8, y1 = std::max(y0 + 1, (y + 1) * h / 8);
+            double sum = 0;
+            for (long py = y0; py < y1 && py < h; py++) {
+                for (long px = x0; px < x1 && px < w; px++) {
+                    const unsigned char *p = pixel + (py * w + px) * channels;
+                    sum += channels == 1 ? p[0] : 0.299 * p[0] + 0.587 * p[1] + 0.114 * p[2];
+                }
+            }
+            cell[y][x] = sum / ((x1 - x0) * (y1 - y0));
+        }
+    }
+    unsigned long long hash = 0;
+    for (int y = 0; y < 8; y++)
+        for (int x = 0; x < 8; x++)
+            if (cell[y][x] < cell[y][x + 1]) hash |= 1ULL << (y * 8 + x);
+    return hash;
+}
+
+void library_open(const char *path) {
+    library_path = path;
+    input_hash = image_hash(input.pixel, input.width, input.height, input.channels);
+    printf("Library: %s, input hash %016llx\n", path, input_hash);
+}
+
+// Bytes of the genome arrays following a record
+static long record_size(const LibraryRecord &r) {
+    long size = r.triangles * (sizeof(double) * (V * 2 + 4) + 1);
+    if (r.mesh) size += r.vertices * sizeof(double) * 2 + r.triangles * sizeof(unsigned short) * V;
+    return size;
+}
+
+// Whether the genome of r fits in the current run: a mesh needs the same pool, plain triangles are truncated or
+// completed with the random ones already there
+static bool usable(const LibraryRecord &r) {
+    if (r.magic != LIBRARY_MAGIC || r.triangles <= 0 || r.triangles > N || !r.mesh != !params.mesh) return false;
+    return !r.mesh || (r.triangles == params.triangles && r.vertices == mesh_vertices());
+}
+
+// Reads the genome of hit into c as it is, the first params.triangles primitives of it if it has more
+static bool read_genome(FILE *f, const LibraryHit &hit, Chromosome &c) {
+    int n = hit.record.triangles, take = std::min(n, params.triangles);
+    long skip = (long) (n - take);
+    bool ok = fseek(f, hit.offset, SEEK_SET) == 0;
+    ok = ok && fread(c.point, sizeof(c.point[0]), take, f) == (size_t) take;
+    ok = ok && fseek(f, skip * sizeof(c.point[0]), SEEK_CUR) == 0;
+    ok = ok && fread(c.color, sizeof(c.color[0]), take, f) == (size_t) take;
+    ok = ok && fseek(f, skip * sizeof(c.color[0]), SEEK_CUR) == 0;
+    ok = ok && fread(c.shape, sizeof(c.shape[0]), take, f) == (size_t) take;
+    ok = ok && fseek(f, skip * sizeof(c.shape[0]), SEEK_CUR) == 0;
+    if (hit.record.mesh) {
+        ok = ok && fread(c.vertex, sizeof(c.vertex[0]), hit.record.vertices, f) == (size_t) hit.record.vertices;
+        ok = ok && fread(c.index, sizeof(c.index[0]), n, f) == (size_t) n;
+    }
+    return ok;
+}
+
+// Reads the genome of hit into c, adapted to the current run
+static bool load(FILE *f, const LibraryHit &hit, Chromosome &c) {
+    if (!read_genome(f, hit, c)) return false;
+    int take = std::min(hit.record.triangles, params.triangles);
+
+    // The current run may use another opacity or allow other shapes than the one the record comes from
+    for (int i = 0; i < take; i++) {
+        c.color[i][3] = params.opacity;
+        if (c.shape[i] >= SHAPE_COUNT || !(params.shapes >> c.shape[i] & 1)) c.shape[i] = random_shape();
+    }
+    if (params.mesh) c.expand();
+    return true;
+}
+
+int library_seed(Chromosome *pop, int count) {
+    if (!library_path || count <= 0) return 0;
+    FILE *f = fopen(library_path, "rb");
+    if (!f) return 0;
+
+    // Nearest usable records, by hash distance then error
+    LibraryHit hits[LIBRARY_NEIGHBOURS];
+    int n_hits = 0, records = 0;
+    LibraryRecord r;
+    while (fread(&r, sizeof(r), 1, f) == 1 && r.magic == LIBRARY_MAGIC) {
+        records++;
+        LibraryHit hit = {__builtin_popcountll(r.hash ^ input_hash), r.error, ftell(f), r};
+        if (fseek(f, record_size(r), SEEK_CUR) != 0) break;
+        if (!usable(r) || hit.distance > LIBRARY_DISTANCE) continue;
+        auto closer = [](const LibraryHit &a, const LibraryHit &b) {
+            return a.distance != b.distance ? a.distance < b.distance : a.error < b.error;
+        };
+        if (n_hits == LIBRARY_NEIGHBOURS && !closer(hit, hits[n_hits - 1])) continue;
+        if (n_hits < LIBRARY_NEIGHBOURS) n_hits++;
+        int i = n_hits - 1;
+        for (; i > 0 && closer(hit, hits[i - 1]); i--) hits[i] = hits[i - 1];
+        hits[i] = hit;
+    }
+
+    // Every hit once as it is, then perturbed copies of them in turn
+    int seeded = 0;
+    for (int i = 0; i < count && n_hits; i++) {
+        if (!load(f, hits[i % n_hits], pop[i])) break;
+        if (i >= n_hits) pop[i].mutate_disturb(500 * RND / params.strength);
+        seeded++;
+    }
+    fclose(f);
+    if (n_hits)
+        printf("Library: seeded %d chromosomes from the %d nearest of %d records (%d bits away at best)\n",
+               seeded, n_hits, records, hits[0].distance);
+    return seeded;
+}
+
+// Appends the record of c (the input it was evolved on has the given hash) to f, closes f
+static bool write_record(FILE *f, const Chromosome &best, unsigned long long hash) {
+    LibraryRecord r = {LIBRARY_MAGIC, params.triangles, params.mesh, params.mesh ? mesh_vertices() : 0, hash,
+                       relative_error(best.fit_val)};
+    int n = params.triangles;
+    bool ok = fwrite(&r, sizeof(r), 1, f) == 1;
+    ok = ok && fwrite(best.point, sizeof(best.point[0]), n, f) == (size_t) n;
+    ok = ok && fwrite(best.color, sizeof(best.color[0]), n, f) == (size_t) n;
+    ok = ok && fwrite(best.shape, sizeof(best.shape[0]), n, f) == (size_t) n;
+    if (params.mesh) {
+        ok = ok && fwrite(best.vertex, sizeof(best.vertex[0]), r.vertices, f) == (size_t) r.vertices;
+        ok = ok && fwrite(best.index, sizeof(best.index[0]), n, f) == (size_t) n;
+    }
+    return fclose(f) == 0 && ok;
+}
+
+bool library_save(const Chromosome &best) {
+    if (!library_path) return false;
+    FILE *f = fopen(library_path, "ab");
+    if (!f || !write_record(f, best, input_hash)) {
+        fprintf(stderr, "Cannot write the library %s\n", library_path);
+        return false;
+    }
+    printf("Library: saved the best chromosome (error %.5f) to %s\n", relative_error(best.fit_val), library_path);
+    return true;
+}
+
+bool genome_save(const char *path, const Chromosome &c) {
+    FILE *f = fopen(path, "wb");
+    if (!f || !write_record(f, c, image_hash(input.pixel, input.width, input.height, input.channels))) {
+        fprintf(stderr, "Cannot write the genome %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+bool genome_load(const char *path, Chromosome &c) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    LibraryHit hit = {};
+    bool ok = fread(&hit.record, sizeof(hit.record), 1, f) == 1 && hit.record.magic == LIBRARY_MAGIC &&
+              hit.record.triangles > 0 && hit.record.triangles <= N;
+    if (ok) {
+        params.triangles = hit.record.triangles;
+        params.mesh = hit.record.mesh;
+        hit.offset = sizeof(hit.record);
+        ok = (!params.mesh || hit.record.vertices == mesh_vertices()) && read_genome(f, hit, c);
+    }
+    fclose(f);
+
+    // The shapes of the genome stay allowed, the opacity is the one of the run that evolved it
+    for (int i = 0; ok && i < params.triangles; i++) {
+        if (c.shape[i] >= SHAPE_COUNT) ok = false;
+        else params.shapes |= 1 << c.shape[i];
+    }
+    if (ok && params.triangles) params.opacity = c.color[0][3];
+    return ok;
+}
@@ -0,0 +1,37 @@
+/*
+ * Warm-start library
+ * A file of (perceptual hash, best genome) records, one appended at the end of every run given --library. A new run
+ * looks up the records whose hash is nearest to the one of its input and starts part of its population from their
+ * genomes, so near-duplicate images pick up where an earlier run stopped instead of starting from random triangles.
+ * The hash is a 64-bit difference hash (the sign of the horizontal gradients of a 9x8 thumbnail), which survives
+ * resizing, re-encoding and small edits; hashes are compared by the number of bits they differ in.
+ */
+
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include "chromosome.h"
+
+#define LIBRARY_DISTANCE 10  // Largest hash distance (bits out of 64) of a record reused for a new input
+#define LIBRARY_NEIGHBOURS 4 // Nearest records a population is seeded from
+#define LIBRARY_SHARE 0.25   // Share of the initial population seeded from the library
+
+// Difference hash of a w x h image of the given bytes per pixel
+unsigned long long image_hash(const unsigned char *pixel, long w, long h, int channels);
+
+// Uses the library in file path (created on the first save) for the current input, which is hashed now
+void library_open(const char *path);
+
+// Overwrites up to count chromosomes of pop with (perturbed copies of) the nearest records, returns how many
+int library_seed(Chromosome *pop, int count);
+
+// Appends best (its genome and error) to the library, does nothing if none was opened
+bool library_save(const Chromosome &best);
+
+// Genome files hold a single record of the same format
+bool genome_save(const char *path, const Chromosome &c);
+
+// Reads the genome in path into c, and sets params.triangles, mesh, shapes and opacity to what it needs
+bool genome_load(const char *path, Chromosome &c);
+
+#endif // LIBRARY_H
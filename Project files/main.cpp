@@ -19,6 +19,37 @@
  *   3. Run "sudo sh ./compile.sh" (without quotes) to compile the source files into an output executable
  *   4. Execute the generated file using "./a.out"
  *
+ * Command line options
+ *   --anneal         optimize with a parallel tempering ensemble (one annealing chain per core) instead of the genetic algorithm
+ *   --deadline MS    headless anytime mode: resolution, population size and operator mix are picked to fit the budget,
+ *                    the best chromosome is written out before MS milliseconds have passed
+ *   --output FILE    image written by the headless modes (default: output.bmp)
+ *   --input FILE     reference image to use instead of INPUT_IMAGE_PATH
+ *   --config FILE    runtime configuration ("key = value" lines, see config.h), --set KEY=VALUE overrides one parameter
+ *   --autotune FILE  tunes the configuration on the --sample FILE images (default: the input image), writes it to FILE
+ *   --trial SECONDS  headless run until --target (relative error, default 0.45) or the CPU budget is reached
+ *   --alloc-check G  headless benchmark, fails if any of G generations (after a short warm-up) allocates memory
+ *                    (only in a build with -DALLOC_CHECK, which hooks the allocator)
+ *   --bench          headless benchmark of the fitness engine: throughput of every rasterizer and metric (see engine.h)
+ *   --check          headless self-checks of the parts that are easy to get subtly wrong (see check.h)
+ *   --numa           pin the workers to cores spread over the NUMA nodes, with node-local buffers and image replicas
+ *   --hugepages      back the buffers of the workers with huge pages when available
+ *   --control FIFO   named pipe accepting "key=value" and "reload" lines; together with changes to the --config file,
+ *                    they are applied to the running genetic algorithm at the next generation boundary
+ *                    "retarget [FILE]" switches to an edited input image, keeping the population (see retarget.h)
+ *   --batch FILE     fits the thumbnail jobs listed in FILE ("input.bmp output.bmp" lines) several at a time, one per
+ *                    SIMD lane, each with its own population (see batch.h)
+ *   --genome FILE    starts the population from the genome in FILE, --save-genome FILE writes the best one when done
+ *   --mask FILE      region of interest: with --genome, only the part of the image where the mask (a BMP) is white is
+ *                    evolved again, by the triangles overlapping it (see roi.h)
+ *   --library FILE   warm-start library: part of the initial population comes from the best chromosomes of earlier runs
+ *                    on similar images, and the best chromosome of this run is added to it when done (see library.h)
+ *   --log FILE       writes every improvement of the best chromosome to FILE, as triangle diffs (see evolog.h)
+ *   --replay FILE    renders --frames N frames (default 1) of such a log to --output, a pattern like frame%04d.bmp for
+ *                    several frames; a single frame is the final state, or --epoch E
+ *   --share NAME     publishes the best frame in the shared-memory object NAME for other processes: --viewer NAME
+ *                    shows it in a window, --snapshot NAME writes it to --output (see viewer.h)
+ *
 */
 
 #define INPUT_IMAGE_PATH "input.bmp"
@@ -28,115 +59,73 @@
 #include <cmath>
 #include <algorithm>
 #include <ctime>
+#include <thread>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
 #include "image_reader.h"
+#include "chromosome.h"
+#include "polish.h"
+#include "anneal.h"
+#include "operators.h"
+#include "anytime.h"
+#include "config.h"
+#include "autotune.h"
+#include "reload.h"
+#include "numa.h"
+#include "alloc_track.h"
+#include "pipeline.h"
+#include "engine.h"
+#include "library.h"
+#include "batch.h"
+#include "roi.h"
+#include "retarget.h"
+#include "check.h"
+#include "evolog.h"
+#include "viewer.h"
+#include "detail.h"
 
 ImageReader input(INPUT_IMAGE_PATH);
+const char *input_path = INPUT_IMAGE_PATH; // file input was read from
 
-// Used macros
-#define POP_SIZE 100  // Population size
-#define N 200         // Number of triangles per chromosome
-#define V 3          // A triangle has 3 vertices
-#define SCALE 512    // Input image, output image, window size are all 512x512
-#define OPACITY 0.15 // Alpha channel value for triangles
-
-// Random number generators, the second one is uniform
-#define RND (2.0 * (double)rand_r(&seed) / RAND_MAX - 1.0)
-#define U_RND ( (double)rand_r (&seed) / RAND_MAX)
-
-typedef long long ll; // just an alias for long long data type
 int epochs = 0; // number of generations
-unsigned int seed = time(nullptr); // random numbers seed
-
-// Chromosome representation: a set of N triangles of various positions/sizes/colors
-struct Chromosome {
-    double point[N][V][2]{};
-    double color[N][4]{};
-    ll fit_val{};
-
-    unsigned char *window;
-    Chromosome() { // ctor initializes memory for window
-        window = (unsigned char *) malloc(sizeof(unsigned char) * input.width * input.height * 3);
-    }
-
-    // Draw *this chromosome to the screen
-    void draw() {
-        glBegin(GL_TRIANGLES);
-        for (int i = 0; i < N; i++) {
-            glColor4f(color[i][0], color[i][1], color[i][2], color[i][3]); // RGBA
-            glVertex2f(point[i][0][0], point[i][0][1]);
-            glVertex2f(point[i][1][0], point[i][1][1]);
-            glVertex2f(point[i][2][0], point[i][2][1]);
-        }
-        glEnd();
-    }
+thread_local unsigned int seed = 0; // random numbers seed, every thread has its own
+unsigned long next_id = 0; // last id given to a chromosome
 
-    // Calculate fitness value (Mean-Square error) between *this chromosome and the input image
-    ll fitness() {
-        ll fit = 0;
-        glClear(GL_COLOR_BUFFER_BIT);
-        draw();
-        glReadPixels(0, 0, input.width, input.height, GL_RGB, GL_UNSIGNED_BYTE, window);
-        glClear(GL_COLOR_BUFFER_BIT);
+// Plateau detection: when the best fitness improves by less than PLATEAU_EPS (relative) over the last PLATEAU_WINDOW
+// generations, mutations get stronger first, and if that does not help, the bottom of the population is re-seeded
+#define PLATEAU_WINDOW 300     // Generations the improvement is measured over
+#define PLATEAU_EPS 0.002      // Minimum relative improvement over the window
+#define PLATEAU_MAX_BOOST 8.0  // Mutation strength after which a stall triggers a re-seed instead
+#define PLATEAU_RESEED 0.5     // Fraction of the population (taken from the bottom) re-seeded on a stall
+#define PLATEAU_RESEED_TRI 0.2 // Fraction of the triangles of a re-seeded chromosome placed from the image
 
-        for (int i = 0; i < input.width * input.height * 3; i += 3) {
-            fit += ((window[i] - input.pixel[i]) * (window[i] - input.pixel[i])) +
-                   ((window[i + 1] - input.pixel[i + 1]) * (window[i + 1] - input.pixel[i + 1])) +
-                   ((window[i + 2] - input.pixel[i + 2]) * (window[i + 2] - input.pixel[i + 2]));
-        }
-        return fit;
-    }
+ll best_history[PLATEAU_WINDOW]; // best fitness of the last generations, circular
+int history_len = 0;
+double mutation_strength = 1.0;  // divides the disturbance of mutate_disturb, raised on a plateau
 
-    // Sorting key, a chromosome is better than another if it has a lower fit value
-    static bool key(const Chromosome &a, const Chromosome &b) {
-        return a.fit_val < b.fit_val;
+// Crossover of mesh genomes: triangles (corner indices and colors) and pool vertices are taken from either parent,
+// before/after the same relative cut point (one-point) or by coin flips
+void mesh_co(const Chromosome &a, const Chromosome &b, Chromosome &c, bool one_point) {
+    double cut = U_RND;
+    for (int i = 0; i < params.triangles; i++) {
+        const Chromosome &s = (one_point ? i < cut * params.triangles : U_RND < 0.5) ? a : b;
+        memcpy(c.index[i], s.index[i], sizeof(c.index[i]));
+        memcpy(c.color[i], s.color[i], sizeof(double) * 3);
     }
-
-    // Mutate *this chromosome by completely changing its position and color
-    void mutate_change() {
-        for (int i = 0; i < N; i++) {
-            for (int j = 0; j < V; j++) {
-                if (U_RND > 0.5f) point[i][j][0] = U_RND;
-                if (U_RND > 0.5f) point[i][j][1] = U_RND;
-            }
-            if (U_RND > 0.5f) {
-                color[i][0] = U_RND;
-                color[i][1] = U_RND;
-                color[i][2] = U_RND;
-            }
-        }
-    }
-
-    // Mutate *this chromosome by introducing small disturbance its position and color, making sure we don't go off-bounds
-    void mutate_disturb(double disturb) {
-        for (int j = 0; j < N; j++) {
-            for (int k = 0; k < V; k++) {
-                if (U_RND < 0.25f) {
-                    point[j][k][0] += RND / disturb;
-                    point[j][k][1] += RND / disturb;
-                }
-                if (point[j][k][0] < .0f || point[j][k][0] > 1.f) {
-                    point[j][k][0] = U_RND;
-                }
-                if (point[j][k][1] < .0f || point[j][k][1] > 1.f) {
-                    point[j][k][1] = U_RND;
-                }
-            }
-            if (U_RND < 0.5f) {
-                color[j][0] += 10 * RND / disturb;
-                color[j][1] += 10 * RND / disturb;
-                color[j][2] += 10 * RND / disturb;
-            }
-            if (color[j][0] < .0f || color[j][0] > 1.f) color[j][0] = U_RND;
-            if (color[j][1] < .0f || color[j][1] > 1.f) color[j][1] = U_RND;
-            if (color[j][2] < .0f || color[j][2] > 1.f) color[j][2] = U_RND;
-        }
+    for (int v = 0; v < mesh_vertices(); v++) {
+        const Chromosome &s = (one_point ? v < cut * mesh_vertices() : U_RND < 0.5) ? a : b;
+        c.vertex[v][0] = s.vertex[v][0];
+        c.vertex[v][1] = s.vertex[v][1];
     }
-};
+    c.expand();
+}
 
 // One-point Crossover, chooses a random point p, swaps DNA before p and leaves the rest unmodified
-void one_point_co(const Chromosome a, const Chromosome b, Chromosome &c) {
-    int p = ceil(U_RND * N);
-    for (int i = 0; i < N; i++) {
+void one_point_co(const Chromosome &a, const Chromosome &b, Chromosome &c) {
+    if (params.mesh) return mesh_co(a, b, c, true);
+    int p = ceil(U_RND * params.triangles);
+    for (int i = 0; i < params.triangles; i++) {
         for (int j = 0; j < V; j++) {
             if (i < p) {
                 c.point[i][j][0] = a.point[i][j][0];
@@ -147,22 +136,25 @@ void one_point_co(const Chromosome a, const Chromosome b, Chromosome &c) {
             }
         }
     }
-    for (int i = 0; i < N; i++) {
+    for (int i = 0; i < params.triangles; i++) {
         if (i < p) {
             c.color[i][0] = a.color[i][0];
             c.color[i][1] = a.color[i][1];
             c.color[i][2] = a.color[i][2];
+            c.shape[i] = a.shape[i];
         } else {
             c.color[i][0] = b.color[i][0];
             c.color[i][1] = b.color[i][1];
             c.color[i][2] = b.color[i][2];
+            c.shape[i] = b.shape[i];
         }
     }
 }
 
 // N-points crossover, flips a coin and swaps/leaves the DNA element (triangles)
-void n_points_co(const Chromosome a, const Chromosome b, Chromosome &c) {
-    for (int i = 0; i < N; i++) {
+void n_points_co(const Chromosome &a, const Chromosome &b, Chromosome &c) {
+    if (params.mesh) return mesh_co(a, b, c, false);
+    for (int i = 0; i < params.triangles; i++) {
         for (int j = 0; j < V; j++) {
             if (U_RND < 0.5) {
                 c.point[i][j][0] = a.point[i][j][0];
@@ -170,12 +162,14 @@ void n_points_co(const Chromosome a, const Chromosome b, Chromosome &c) {
                 c.color[i][0] = a.color[i][0];
                 c.color[i][1] = a.color[i][1];
                 c.color[i][2] = a.color[i][2];
+                c.shape[i] = a.shape[i];
             } else {
                 c.point[i][j][0] = b.point[i][j][0];
                 c.point[i][j][1] = b.point[i][j][1];
                 c.color[i][0] = b.color[i][0];
                 c.color[i][1] = b.color[i][1];
                 c.color[i][2] = b.color[i][2];
+                c.shape[i] = b.shape[i];
             }
         }
     }
@@ -183,23 +177,104 @@ void n_points_co(const Chromosome a, const Chromosome b, Chromosome &c) {
 
 // Population is represented as an array of struct Chromosome.
 Chromosome population[POP_SIZE];
+Chromosome offspring[POP_SIZE]; // children of the generation being bred, swapped into the population once scored
+double deadline = 0;     // now_seconds() at which a generation stops breeding, 0 for none
+const char *output = "output.bmp"; // image written by the headless modes and by periodic exports
+const char *config = nullptr;      // configuration file and control pipe watched for live changes
+const char *control = nullptr;
+Chromosome *genome = nullptr;      // --genome, the run starts from it
+const char *genome_out = nullptr;  // --save-genome
 
 // Generates an initial random population
 void gen_pop(Chromosome *pop) {
-    for (int i = 0; i < POP_SIZE; i++) {
-        for (int j = 0; j < N; j++) {
-            for (int k = 0; k < V; k++) {
-                pop[i].point[j][k][0] = U_RND;
-                pop[i].point[j][k][1] = U_RND;
+    for (int i = 0; i < params.pop_size; i++) {
+        for (int j = 0; j < params.triangles; j++) {
+            if (!detail_place(pop[i].point[j])) {
+                for (int k = 0; k < V; k++) {
+                    pop[i].point[j][k][0] = U_RND;
+                    pop[i].point[j][k][1] = U_RND;
+                }
             }
             pop[i].color[j][0] = U_RND;
             pop[i].color[j][1] = U_RND;
             pop[i].color[j][2] = U_RND;
-            pop[i].color[j][3] = OPACITY;
+            pop[i].color[j][3] = params.opacity;
+            pop[i].shape[j] = random_shape();
+        }
+        if (params.mesh) {
+            for (int v = 0; v < mesh_vertices(); v++) {
+                pop[i].vertex[v][0] = U_RND;
+                pop[i].vertex[v][1] = U_RND;
+            }
+            for (int j = 0; j < params.triangles; j++)
+                for (int k = 0; k < V; k++) pop[i].index[j][k] = rand_r(&seed) % mesh_vertices();
+            pop[i].expand();
         }
     }
 }
 
+// Image-guided primitive: a small one around a random point (preferably a detailed one), colored like the input image there
+// A point picked by the detail map comes with the spread of a primitive there, which scales the size: smaller where the
+// detail is finer, but a seed stays small (0.02 to 0.1) wherever it lands
+void seed_triangle(Chromosome &c, int t) {
+    double cx, cy, spread;
+    bool detailed = detail_point(cx, cy, spread);
+    if (!detailed) {
+        cx = U_RND;
+        cy = U_RND;
+    }
+    double size = 0.02 + 0.08 * U_RND;
+    if (detailed) size = std::min(0.1, std::max(0.02, size * spread / DETAIL_SIZE));
+    c.shape[t] = random_shape();
+    for (int k = 0; k < V; k++) {
+        c.point[t][k][0] = std::min(1.0, std::max(0.0, cx + size * RND));
+        c.point[t][k][1] = std::min(1.0, std::max(0.0, cy + size * RND));
+    }
+    if (c.shape[t] == SHAPE_ELLIPSE || c.shape[t] == SHAPE_CIRCLE) {
+        c.point[t][0][0] = cx; // centered on the sampled pixel
+        c.point[t][0][1] = cy;
+    }
+    if (params.mesh) { // the corners of a mesh triangle are shared, moving them drags the neighbors along
+        for (int k = 0; k < V; k++) {
+            c.move_vertex(c.index[t][k], 0, c.point[t][k][0]);
+            c.move_vertex(c.index[t][k], 1, c.point[t][k][1]);
+        }
+    }
+    long px = std::min(input.width - 1, (long) (cx * input.width));
+    long py = std::min(input.height - 1, (long) (cy * input.height));
+    const unsigned char *rgb = input.pixel + (py * input.width + px) * channels;
+    for (int k = 0; k < 3; k++) c.color[t][k] = rgb[channels == 1 ? 0 : k] / 255.0;
+    c.color[t][3] = params.opacity;
+}
+
+// Partial restart of pop[from, pop_size): each becomes a copy of a random elite with some triangles re-placed from the image
+// The triangles crowding flat regions are the likeliest to go, see detail_bias
+void reseed(Chromosome *pop, int from, int elites) {
+    double bias[N];
+    for (int i = from; i < params.pop_size; i++) {
+        const Chromosome &e = pop[rand_r(&seed) % elites];
+        detail_bias(e.point, e.shape, params.triangles, bias);
+        memcpy(pop[i].point, e.point, sizeof(e.point));
+        memcpy(pop[i].color, e.color, sizeof(e.color));
+        memcpy(pop[i].shape, e.shape, sizeof(e.shape));
+        memcpy(pop[i].vertex, e.vertex, sizeof(e.vertex));
+        memcpy(pop[i].index, e.index, sizeof(e.index));
+        for (int j = 0; j < params.triangles; j++)
+            if (U_RND < PLATEAU_RESEED_TRI * bias[j]) seed_triangle(pop[i], j);
+        roi_constrain(pop[i]);
+        pop[i].fit_val = pop[i].fitness();
+        pop[i].id = ++next_id;
+    }
+}
+
+// Records the best fitness of this generation, returns true when the run has stalled over the whole window
+bool plateau(ll best) {
+    best_history[history_len++ % PLATEAU_WINDOW] = best;
+    if (history_len < PLATEAU_WINDOW) return false;
+    ll oldest = best_history[history_len % PLATEAU_WINDOW];
+    return oldest - best < PLATEAU_EPS * oldest;
+}
+
 // Display function used by OpenGL, called to update screen when a window even is received
 // Number of calls per second defined the FPS
 void gl_display() {
@@ -214,58 +289,578 @@ void gl_display() {
     glutSwapBuffers();
 }
 
-// OpenGL idle function, called when no window events are being received
-// Implements the selection strategy of the algorithm, updating the population chromosomes
-// Number of calls per second defines the generation rate, a call represents one generation.
-void gl_idle() {
+// Number of background workers: params.threads, or by default every spare core (every core if the main thread idles)
+int workers(bool main_busy) {
+    if (params.threads >= 0) return params.threads;
+    return (int) std::thread::hardware_concurrency() - (main_busy ? 1 : 0);
+}
+
+// State of the children of the current generation, indexed like the population
+int child_op[POP_SIZE];
+double child_cost[POP_SIZE]; // thread CPU time spent breeding and scoring
+bool child_ready[POP_SIZE];  // scored, replaces its population slot at the end of the generation
+bool child_flight[POP_SIZE]; // bred, but its completion was not reported yet (set by the breed stage itself)
+bool child_stale[POP_SIZE];  // still in flight from an earlier generation, the slot is not bred again until it lands
+ll cut;                      // fitness of the worst elite, a child better than this one makes it into the elites
+
+// Pipeline stage, any thread: breeds the child of slot i from the (read-only) population into offspring[i]
+bool breed_child(int i) {
+    if (child_stale[i]) return false;
+    child_ready[i] = false;
+    if (deadline && now_seconds() >= deadline) return false; // anytime mode: never breed past the deadline
+    child_flight[i] = true; // only a bred child is in flight, a skipped slot keeps the state of its last child
+    double start = thread_seconds();
+    int op = op_pick(seed);
+    Chromosome &c = offspring[i];
+    if (op == OP_ONE_POINT || op == OP_N_POINTS) {
+        // select two random individuals
+        int a = ((int) round(U_RND * params.pop_size)) % params.pop_size;
+        int b = ((int) round(U_RND * params.pop_size)) % params.pop_size;
+
+        if (op == OP_ONE_POINT) one_point_co(population[a], population[b], c);
+        else n_points_co(population[a], population[b], c);
+
+    } else {
+        memcpy(c.point, population[i].point, sizeof(c.point));
+        memcpy(c.color, population[i].color, sizeof(c.color));
+        memcpy(c.shape, population[i].shape, sizeof(c.shape));
+        memcpy(c.vertex, population[i].vertex, sizeof(c.vertex));
+        memcpy(c.index, population[i].index, sizeof(c.index));
+        if (op == OP_DISTURB) c.mutate_disturb(500 * RND / (mutation_strength * params.strength));
+        else c.mutate_change();
+    }
+    roi_constrain(c);
+    child_op[i] = op;
+    child_cost[i] = thread_seconds() - start;
+    return true;
+}
+
+// Pipeline stage, any thread: calculates the fitness value of the child, stored as a field to be used later for sorting
+void score_child(int i) {
+    double start = thread_seconds();
+    offspring[i].fit_val = offspring[i].fitness();
+    child_cost[i] += thread_seconds() - start;
+}
+
+// Pipeline completion, on the thread running the generation: credits the operator and publishes improvements
+// With params.staleness, a child may land one or more generations after it was bred
+// A skip may be reported generations later, after the slot was bred again: it must not touch the state of the slot
+void child_done(int i, bool skipped) {
+    if (skipped) return;
+    child_flight[i] = false;
+    Chromosome &c = offspring[i];
+    c.id = ++next_id;
+    op_record(child_op[i], std::max(0.0, (double) (cut - c.fit_val) / cut), child_cost[i]);
+    best_publish(c);
+    child_ready[i] = true;
+}
+
+// Node the child of slot i is rendered into (see numa_window)
+int child_node(int i) {
+    return std::max(0, offspring[i].home);
+}
+
+const PipelineStages child_stages = {breed_child, score_child, child_done, child_node};
+
+// Applies parameters changed while running (see reload.h), at a generation boundary
+void apply_params(Params next) {
+    // The shape of the population and of the chromosomes, and the meaning of a fitness value are fixed for the whole run
+    if (next.pop_size != params.pop_size || next.triangles != params.triangles || next.opacity != params.opacity ||
+        next.raster != params.raster || next.metric != params.metric || next.mesh != params.mesh) {
+        printf("Generation: %d, pop_size, triangles, opacity, raster, metric and mesh cannot change during a run, "
+               "ignored\n", epochs);
+        next.pop_size = params.pop_size;
+        next.triangles = params.triangles;
+        next.opacity = params.opacity;
+        next.raster = params.raster;
+        next.metric = params.metric;
+        next.mesh = params.mesh;
+    }
+    bool mix = next.crossover != params.crossover || next.one_point != params.one_point || next.disturb != params.disturb;
+    bool threads = next.threads != params.threads;
+    params = next;
+    if (mix) op_set_mix(params.crossover, params.one_point, params.disturb);
+    if (threads) {
+        polish_stop();
+        pipeline_stop();
+        pipeline_start(workers(true), child_stages);
+        polish_start(workers(true));
+    }
+    printf("Generation: %d, configuration reloaded:\n", epochs);
+    save_params(stdout, params);
+}
+
+// Switches the run to the image in path (the input image file if empty) without starting over, see retarget.h
+void retarget(const char *path) {
+    if (!*path) path = input_path;
+    if (deadline) {
+        printf("Generation: %d, the anytime mode cannot retarget, ignored\n", epochs);
+        return;
+    }
+    unsigned char *fresh = retarget_load(path);
+    if (!fresh) return;
+    double start = now_seconds();
+    int count;
+    Rect *changed = retarget_diff(fresh, count);
+    long area = 0;
+    for (int i = 0; i < count; i++) area += (long) (changed[i].x1 - changed[i].x0) * (changed[i].y1 - changed[i].y0);
+
+    // Nothing may be scored against the old target meanwhile: the polishers drop their work, the stragglers land now
+    polish_stop();
+    pipeline_run(0, 0, 0);
+    for (int i = 0; i < params.pop_size; i++) child_flight[i] = child_stale[i] = false; // every child has landed
+    unsigned char *old = input.pixel;
+    for (int i = 0; i < params.pop_size && !roi_count; i++) {
+        population[i].fit_val += retarget_delta(population[i], old, fresh, changed, count);
+        if (child_ready[i]) offspring[i].fit_val += retarget_delta(offspring[i], old, fresh, changed, count);
+    }
+    // A new buffer, so that the NUMA replicas of the target are made again. The old one is not freed: a replica is
+    // recognized by the address of its source, which must not come back
+    input.pixel = fresh;
+    if (roi_count) { // a region is only scored where it is masked, it is simpler to score it again
+        for (int i = 0; i < params.pop_size; i++) {
+            population[i].fit_val = population[i].fitness();
+            if (child_ready[i]) offspring[i].fit_val = offspring[i].fitness();
+        }
+    }
+    delete[] changed;
+    best_reset();
+    history_len = 0;
+    polish_start(workers(true));
+    printf("Generation: %d, retargeted to %s, %.1f%% of the image changed, population rescored in %.0fms\n", epochs,
+           path, 100.0 * area / (input.width * input.height), (now_seconds() - start) * 1000);
+}
+
+// One generation: implements the selection strategy of the algorithm, updating the population chromosomes
+void evolve() {
     epochs++;
+    Params next = params;
+    if (reload_fetch(next)) apply_params(next);
+    char path[512];
+    if (reload_retarget(path, sizeof(path))) retarget(path);
+    int elites = std::min(params.pop_size - 1, std::max(1, (int) ceil(params.pop_size * params.elite)));
+    int bred = params.pop_size;
+
+    // Take in the elites polished in the background since the last generation
+    polish_collect(population, params.pop_size);
 
     // Sort the population based on the fitness_value
-    std::sort(population, population + POP_SIZE, Chromosome::key);
-    
+    std::sort(population, population + params.pop_size, Chromosome::key);
+    best_publish(population[0]);
+    evolog_record(epochs, population[0]);
+    viewer_publish(epochs, population[0].fit_val, population[0].window, input.width, input.height);
+    if (params.detail > 0 && epochs % DETAIL_REFRESH == 0) detail_update(population[0].window);
+    if (params.export_every && epochs % params.export_every == 0)
+        ImageReader::WriteBmpFile(output, population[0].window, input.width, input.height, channels);
+
+    // Idle workers get fresh copies of the elites to polish while this generation is being bred
+    polish_dispatch(population, elites);
+
     // print status
-    if(epochs%101 == 0) printf("Generation: %d, Best fitness: %lld\n", epochs, population[0].fit_val);
-    // Best 25% of the population advances to the next generation without modification
-    // Rest 75% of the population are being mutated or crossover-ed by this loop
-    for (int i = POP_SIZE - ceil(POP_SIZE * 0.75); i < POP_SIZE; i++) {
-        if (U_RND < 0.95) { // 95% probability to do crossover
-            // select two random individuals
-            int a = ((int) round(U_RND * POP_SIZE)) % POP_SIZE;
-            int b = ((int) round(U_RND * POP_SIZE)) % POP_SIZE;
-
-            // 50% probability to do one-point crossover, 50% - n-points crossover
-            if (U_RND < 0.5) one_point_co(population[a], population[b], population[i]);
-            else n_points_co(population[a], population[b], population[i]);
+    if(epochs % params.status_every == 0) {
+        printf("Generation: %d, Best fitness: %lld\n", epochs, population[0].fit_val);
+        if (params.staleness) printf("Children still scoring from earlier generations: %d\n", pipeline_pending());
+        op_print(stdout);
+    }
 
+    // Escape plateaus: stronger mutations first, then a partial restart of the bottom of the population
+    if (plateau(population[0].fit_val)) {
+        history_len = 0;
+        if (mutation_strength < PLATEAU_MAX_BOOST) {
+            mutation_strength *= 2;
+            printf("Generation: %d, plateau at %lld, mutation strength raised to %.0fx\n",
+                   epochs, population[0].fit_val, mutation_strength);
         } else {
-            if (U_RND < 0.95) // 95% probability to do disturb mutation, 5% - complete change
-                population[i].mutate_disturb(500 * RND);
-            else population[i].mutate_change();
+            mutation_strength = 1.0;
+            bred = params.pop_size - (int) (params.pop_size * PLATEAU_RESEED);
+            reseed(population, bred, elites);
+            printf("Generation: %d, plateau at %lld, re-seeded the bottom %.0f%% of the population\n",
+                   epochs, population[0].fit_val, PLATEAU_RESEED * 100);
         }
+    }
 
-        // Calculate new fitness value for each modified chromosome and store it as a field to be used later for sorting
-        population[i].fit_val = population[i].fitness();
+    // Best 25% (params.elite) of the population advances to the next generation without modification
+    // Rest of the population are being replaced by mutated or crossover-ed children (except the re-seeded ones, if any)
+    // The children are bred and scored by the pipeline (see pipeline.h), selection stays on this thread
+    // The operator mix is adapted online, see operators.h
+    cut = population[elites - 1].fit_val;
+    // With params.staleness, up to that many children may still be scoring when the next generation starts breeding
+    pipeline_run(elites, bred, params.staleness);
+    // Over every slot: a hot reload of params.elite may have moved slots with a child in flight into the elites. A late
+    // child never replaces an elite, but its slot must still leave the stale state once it lands
+    for (int i = 0; i < params.pop_size; i++) {
+        if (child_ready[i] && i >= elites) std::swap(population[i], offspring[i]);
+        child_ready[i] = false;
+        child_stale[i] = child_flight[i];
     }
+    if (params.adaptive) op_update();
+}
+
+// OpenGL idle function, called when no window events are being received
+// Number of calls per second defines the generation rate, a call represents one generation.
+void gl_idle() {
+    evolve();
     glutPostRedisplay();
 }
 
+// OpenGL idle function used instead of gl_idle when the annealing ensemble (--anneal) does the optimization
+// The chains run on their own threads, this only exchanges temperatures and fetches the best state for the display
+void anneal_idle() {
+    epochs++;
+    anneal_exchange();
+    if (anneal_best(population[0])) {
+        evolog_record(epochs, population[0]);
+        viewer_publish(epochs, population[0].fit_val, population[0].window, input.width, input.height);
+        glutPostRedisplay();
+    }
+
+    // print status
+    if (epochs % params.status_every == 0) printf("Steps: %ld, Best fitness: %lld\n", anneal_steps(), population[0].fit_val);
+    usleep(ANNEAL_EXCHANGE_MS * 1000);
+}
+
+// Starts pop from genome: the first chromosome is a copy, the others disturbed copies
+void seed_genome(Chromosome *pop) {
+    for (int i = 0; i < params.pop_size; i++) {
+        memcpy(pop[i].point, genome->point, sizeof(genome->point));
+        memcpy(pop[i].color, genome->color, sizeof(genome->color));
+        memcpy(pop[i].shape, genome->shape, sizeof(genome->shape));
+        memcpy(pop[i].vertex, genome->vertex, sizeof(genome->vertex));
+        memcpy(pop[i].index, genome->index, sizeof(genome->index));
+        if (i) pop[i].mutate_disturb(500 * RND / params.strength);
+    }
+}
+
+// Generates, scores and sorts the initial population
+void init_population() {
+    detail_update(nullptr);
+    gen_pop(population);
+    if (genome) seed_genome(population);
+    library_seed(population, (int) (params.pop_size * LIBRARY_SHARE));
+
+    // With a region of interest, every window starts from the frozen render and only the region is ever redrawn
+    if (roi_count) {
+        for (int i = 0; i < params.pop_size; i++) {
+            roi_constrain(population[i]);
+            roi_prepare(population[i]);
+            roi_prepare(offspring[i]);
+        }
+    }
+    for (int i = 0; i < params.pop_size; i++) {
+        population[i].fit_val = population[i].fitness();
+        population[i].id = ++next_id;
+    }
+    std::sort(population, population + params.pop_size, Chromosome::key);
+    best_publish(population[0]); // the best so far must be there even if not a single generation runs
+
+    // Crossover copies only the RGB of the triangles, the children keep the opacity set here
+    for (int i = 0; i < params.pop_size; i++)
+        for (int j = 0; j < params.triangles; j++) offspring[i].color[j][3] = params.opacity;
+}
+
+// Adds the best chromosome of a finished run to the warm-start library and/or writes it to --save-genome
+// With a region of interest, checks first that the genome renders the output (see roi_mismatch)
+void save_results(const Chromosome &best) {
+    if (long n = roi_mismatch(best)) fprintf(stderr, "Region: %ld pixels of the output differ from the genome\n", n);
+    library_save(best);
+    if (genome_out && genome_save(genome_out, best)) printf("Genome written to %s\n", genome_out);
+}
+
+// Headless run that stops within budget_ms milliseconds and writes the best chromosome found to output
+int run_anytime(double budget_ms, const char *output) {
+    double start = now_seconds(), budget = budget_ms / 1000;
+
+    // Calibration: one full resolution evaluation and one write of the output, which is what the final export costs
+    gen_pop(population);
+    double t = now_seconds();
+    population[0].fitness();
+    double full_eval = now_seconds() - t;
+    ImageReader::WriteBmpFile(output, population[0].window, input.width, input.height, channels);
+    double finish = 2 * (now_seconds() - t); // with room for a busier machine
+
+    AnytimePlan plan = anytime_plan(budget - (now_seconds() - start) - finish, full_eval);
+    deadline = start + budget - finish; // the final export must fit before the end of the budget too
+    set_resolution(plan.level);
+    roi_layout();
+    params.pop_size = plan.pop_size;
+    op_set_mix(plan.crossover, params.one_point, params.disturb);
+    printf("Budget: %.0fms, level: %d (%ldx%ld), population: %d, crossover: %.0f%%\n",
+           budget_ms, plan.level, input.width, input.height, params.pop_size, plan.crossover * 100);
+
+    init_population();
+    pipeline_start(workers(true), child_stages);
+    polish_start(workers(true));
+    reload_start(config, control, params);
+    // A generation is only started if one as long as the longest so far still ends before the deadline, with as much
+    // again for the children in flight to land and the threads to stop
+    double generation = 0;
+    for (double now = now_seconds(); now + 2 * generation < deadline;) {
+        evolve();
+        double end = now_seconds();
+        generation = std::max(generation, end - now);
+        now = end;
+    }
+    polish_stop();
+    pipeline_stop();
+
+    // Render the best chromosome so far at full resolution
+    set_resolution(0);
+    roi_layout();
+    Chromosome &best = population[0];
+    best_fetch(best); // keeps population[0] if nothing was published
+    roi_constrain(best); // a triangle in the region at the level it evolved at may reach a pixel out of it here
+    roi_prepare(best);
+    best.fit_val = best.fitness();
+    ImageReader::WriteBmpFile(output, best.window, input.width, input.height, channels);
+    printf("Generations: %d, best fitness: %lld, written to %s after %.0fms\n",
+           epochs, best.fit_val, output, (now_seconds() - start) * 1000);
+    save_results(best);
+    reload_stop(); // may wait for one poll of the watcher, so only once the image is out
+    return 0;
+}
+
+// Headless trial for the auto-tuner: evolves until the target relative error or the CPU budget is reached
+int run_trial(double budget, double target) {
+    double start = (double) clock() / CLOCKS_PER_SEC;
+    init_population();
+    pipeline_start(workers(true), child_stages);
+    polish_start(workers(true));
+    double err = relative_error(population[0].fit_val), cpu = 0;
+    while (err > target && (cpu = (double) clock() / CLOCKS_PER_SEC - start) < budget) {
+        evolve();
+        err = relative_error(std::min_element(population, population + params.pop_size, Chromosome::key)->fit_val);
+    }
+    polish_stop();
+    pipeline_stop();
+    printf("Trial: cpu=%.3f error=%.5f\n", (double) clock() / CLOCKS_PER_SEC - start, err);
+    save_results(*std::min_element(population, population + params.pop_size, Chromosome::key));
+    return 0;
+}
+
+// Benchmark failing (exit status 1) if any generation after the warm-up allocates memory, on any thread
+int run_alloc_check(int generations) {
+    if (!alloc_hooked()) {
+        fprintf(stderr, "--alloc-check needs a build with -DALLOC_CHECK (see compile.sh)\n");
+        return 1;
+    }
+    init_population();
+    pipeline_start(workers(true), child_stages);
+    polish_start(workers(true));
+    int failed = 0;
+    for (int g = 0; g < ALLOC_WARMUP + generations; g++) {
+        long before = alloc_count();
+        alloc_track(true);
+        evolve();
+        alloc_track(false);
+        long n = alloc_count() - before;
+        bool steady = g >= ALLOC_WARMUP;
+        printf("Generation: %d, allocations: %ld%s\n", epochs, n, steady ? "" : " (warm-up)");
+        if (steady && n) failed++;
+    }
+    polish_stop();
+    pipeline_stop();
+    printf("%s: %d of %d steady-state generations allocated\n", failed ? "FAIL" : "PASS", failed, generations);
+    return failed ? 1 : 0;
+}
+
+// Headless self-checks, see check.h. The anytime mode is checked last, it changes the resolution and the population size
+int run_checks() {
+    check_mpmc();
+    check_evolog();
+    check_viewer();
+
+    // A budget too short for a single generation still writes the best of the initial population
+    const char *out = check_temp();
+    run_anytime(CHECK_DEADLINE_MS, out);
+    ImageReader written;
+    bool blank = true;
+    if (written.LoadBmpFile(out)) {
+        long bytes = written.width * written.height * written.channels;
+        for (long i = 1; i < bytes && blank; i++) blank = written.pixel[i] == written.pixel[0];
+    }
+    check("anytime mode without a generation writes the initial best", !blank);
+
+    check_cleanup();
+    printf("%s: %d checks failed\n", check_failures() ? "FAIL" : "PASS", check_failures());
+    return check_failures() ? 1 : 0;
+}
+
+#define BENCH_SECONDS 0.5 // Time spent measuring each rasterizer and each metric
+
+// Throughput of every rasterizer and metric policy of the fitness engine, measured on a random population
+int run_bench() {
+    init_population();
+    Rect all = {0, 0, (int) input.width, (int) input.height};
+    double pixels = (double) input.width * input.height;
+    printf("Image: %ldx%ld, triangles: %d\n", input.width, input.height, params.triangles);
+    for (int r = 0; r < RASTER_COUNT; r++) {
+        const EngineOps *e = engine_get(r, METRIC_SSE);
+        long n = 0;
+        double start = now_seconds(), t;
+        do {
+            Chromosome &c = population[n++ % params.pop_size];
+            e->render(c.point, c.shape, c.color, params.triangles, c.window, input.width, input.height, all, nullptr);
+        } while ((t = now_seconds() - start) < BENCH_SECONDS);
+        printf("Rasterizer %-8s %10.1f renders/s %10.1f Mpixel/s\n", raster_names[r], n / t, n * pixels / t / 1e6);
+    }
+    for (int m = 0; m < METRIC_COUNT; m++) {
+        const EngineOps *e = engine_get(RASTER_SCALAR, m);
+        long n = 0;
+        double start = now_seconds(), t;
+        do {
+            e->error(population[n++ % params.pop_size].window, target_pixels(), input.width, all);
+        } while ((t = now_seconds() - start) < BENCH_SECONDS);
+        printf("Metric     %-8s %10.1f scores/s  %10.1f Mpixel/s\n", metric_names[m], n / t, n * pixels / t / 1e6);
+    }
+    return 0;
+}
+
+// Saves the best chromosome of an interactive run when the window is closed
+void save_best() {
+    save_results(population[0]);
+}
+
 // Main entry point of the program, initializes window, population, and runs the main visualization loop
 int main(int argc, char **argv) {
+    srand(time(nullptr));
+    seed = time(nullptr);
+
+    // Options of the program, anything else is left to glutInit
+    bool anneal = false, numa = false, huge = false;
+    double budget_ms = 0, trial = 0, target = AUTOTUNE_TARGET;
+    int alloc_check = 0;
+    bool bench = false, checks = false;
+    const char *tune = nullptr, *library = nullptr, *jobs = nullptr, *genome_in = nullptr, *mask = nullptr;
+    const char *log_path = nullptr, *replay = nullptr, *share = nullptr, *view = nullptr, *snapshot = nullptr;
+    int frames = 1, replay_epoch = -1;
+    std::vector<const char *> samples;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--anneal")) anneal = true;
+        else if (!strcmp(argv[i], "--numa")) numa = true;
+        else if (!strcmp(argv[i], "--hugepages")) huge = true;
+        else if (!strcmp(argv[i], "--bench")) bench = true;
+        else if (!strcmp(argv[i], "--check")) checks = true;
+        else if (!strcmp(argv[i], "--deadline") && i + 1 < argc) budget_ms = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--output") && i + 1 < argc) output = argv[++i];
+        else if (!strcmp(argv[i], "--input") && i + 1 < argc) {
+            if (!input.LoadBmpFile(input_path = argv[++i])) {
+                fprintf(stderr, "Cannot read %s\n", argv[i]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--config") && i + 1 < argc) {
+            if (!load_params(config = argv[++i], params)) return 1;
+        } else if (!strcmp(argv[i], "--control") && i + 1 < argc) {
+            control = argv[++i];
+        } else if (!strcmp(argv[i], "--set") && i + 1 < argc) {
+            if (!set_param(params, argv[++i])) {
+                fprintf(stderr, "Bad parameter: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--trial") && i + 1 < argc) trial = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--target") && i + 1 < argc) target = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--alloc-check") && i + 1 < argc) alloc_check = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--autotune") && i + 1 < argc) tune = argv[++i];
+        else if (!strcmp(argv[i], "--sample") && i + 1 < argc) samples.push_back(argv[++i]);
+        else if (!strcmp(argv[i], "--library") && i + 1 < argc) library = argv[++i];
+        else if (!strcmp(argv[i], "--batch") && i + 1 < argc) jobs = argv[++i];
+        else if (!strcmp(argv[i], "--genome") && i + 1 < argc) genome_in = argv[++i];
+        else if (!strcmp(argv[i], "--save-genome") && i + 1 < argc) genome_out = argv[++i];
+        else if (!strcmp(argv[i], "--mask") && i + 1 < argc) mask = argv[++i];
+        else if (!strcmp(argv[i], "--log") && i + 1 < argc) log_path = argv[++i];
+        else if (!strcmp(argv[i], "--replay") && i + 1 < argc) replay = argv[++i];
+        else if (!strcmp(argv[i], "--frames") && i + 1 < argc) frames = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--epoch") && i + 1 < argc) replay_epoch = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--share") && i + 1 < argc) share = argv[++i];
+        else if (!strcmp(argv[i], "--viewer") && i + 1 < argc) view = argv[++i];
+        else if (!strcmp(argv[i], "--snapshot") && i + 1 < argc) snapshot = argv[++i];
+        else if (!strncmp(argv[i], "--", 2)) {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (tune) {
+        if (samples.empty()) samples.push_back(INPUT_IMAGE_PATH);
+        return autotune(tune, samples.data(), (int) samples.size(), target);
+    }
+    if (jobs) return run_batch(jobs);
+    if (replay) return evolog_replay(replay, frames, replay_epoch, output, workers(false));
+    if (view) return run_viewer(view, &argc, argv);
+    if (snapshot) return viewer_snapshot(snapshot, output);
+
+    // Fitness engine of the run, see engine.h, grayscale images get the single channel one
+    engine_select(params.raster, params.metric, input.channels);
+    if (channels == 1) printf("Grayscale input, rendering and scoring a single channel\n");
+    if (library) library_open(library);
+    if (log_path) {
+        if (!evolog_open(log_path)) return 1;
+        atexit(evolog_close);
+    }
+    if (share) {
+        if (!viewer_share(share, input.width * input.height * channels)) return 1;
+        atexit(viewer_unshare);
+    }
+
+    // Worker placement, the main thread takes the first core
+    numa_setup(numa, huge);
+    numa_pin(0);
+
+    for (auto &i : population) i = Chromosome();
+    for (auto &i : offspring) i = Chromosome();
+    // With several nodes, the windows children are scored into are spread over them (they move between slots with
+    // the members they belong to, the pipeline follows them)
+    for (int i = 0; i < POP_SIZE; i++) {
+        numa_window(population[i], i % numa_nodes());
+        numa_window(offspring[i], i % numa_nodes());
+    }
+    if (genome_in) {
+        genome = new Chromosome();
+        if (!genome_load(genome_in, *genome)) {
+            fprintf(stderr, "Cannot read the genome %s\n", genome_in);
+            return 1;
+        }
+    }
+    if (mask) {
+        if (!genome || anneal || params.mesh) {
+            fprintf(stderr, "--mask needs a --genome of triangles, and the genetic algorithm\n");
+            return 1;
+        }
+        if (!roi_start(mask, *genome)) return 1;
+        roi_layout();
+    }
+    op_set_mix(params.crossover, params.one_point, params.disturb);
+    if (trial > 0) return run_trial(trial, target);
+    if (alloc_check > 0) return run_alloc_check(alloc_check);
+    if (bench) return run_bench();
+    if (checks) return run_checks();
+    if (budget_ms > 0) return run_anytime(budget_ms, output);
+
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
     glutInitWindowSize(SCALE, SCALE);
     glutInitWindowPosition(0, 0);
     glutCreateWindow("GeneticArt");
 
-    srand(time(nullptr));
-
-    for (auto &i : population) i = Chromosome();
-    gen_pop(population);
-
-    for (auto &i : population) i.fit_val = i.fitness();
-    std::sort(population, population + POP_SIZE, Chromosome::key);
+    init_population();
 
     glutDisplayFunc(gl_display);
-    glutIdleFunc(gl_idle);
+    if (anneal) {
+        // One chain per core, started from the best random chromosomes
+        anneal_start(workers(false), population);
+        atexit(anneal_stop);
+        glutIdleFunc(anneal_idle);
+    } else {
+        // Every core but the one running the main loop helps breeding, and polishes elites when idle
+        pipeline_start(workers(true), child_stages);
+        polish_start(workers(true));
+        atexit(pipeline_stop);
+        atexit(polish_stop);
+
+        // Long runs can be steered live through the configuration file and the control pipe
+        reload_start(config, control, params);
+        atexit(reload_stop);
+        glutIdleFunc(gl_idle);
+    }
+    atexit(save_best); // runs first, while the best chromosome is still being kept up to date
     glutMainLoop();
 }
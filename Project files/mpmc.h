@@ -0,0 +1,74 @@
+/*
+ * Bounded lock-free multi-producer multi-consumer queue (Dmitry Vyukov's design)
+ * Every cell carries a sequence number telling whether it is ready to be written or read for the current lap, so
+ * producers and consumers only contend on their own position counter, with a single compare-and-swap per operation.
+ */
+
+#ifndef MPMC_H
+#define MPMC_H
+
+#include <atomic>
+#include <cstddef>
+
+template<typename T, size_t Capacity>
+class MpmcQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+    struct Cell {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    alignas(64) Cell cells[Capacity];
+    alignas(64) std::atomic<size_t> head{0}; // next position to write
+    alignas(64) std::atomic<size_t> tail{0}; // next position to read
+
+public:
+    MpmcQueue() {
+        for (size_t i = 0; i < Capacity; i++) cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    // Returns false if the queue is full
+    bool push(const T &value) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        while (true) {
+            Cell &cell = cells[pos & (Capacity - 1)];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            long diff = (long) seq - (long) pos;
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns false if the queue is empty
+    bool pop(T &value) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        while (true) {
+            Cell &cell = cells[pos & (Capacity - 1)];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            long diff = (long) seq - (long) (pos + 1);
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = cell.value;
+                    cell.seq.store(pos + Capacity, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+#endif // MPMC_H
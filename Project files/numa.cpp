@@ -0,0 +1,177 @@
+/*
+ * NUMA-aware placement for the background workers, see numa.h
+ */
+
+#include "numa.h"
+#include "chromosome.h"
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
+
+static bool pinning = false, huge_pages = false;
+static int n_nodes = 1;
+static int cpus[CPU_SETSIZE]; // cores in pinning order, interleaved across nodes
+static int cpu_node[CPU_SETSIZE];
+static int n_cpus = 0;
+
+static thread_local int my_node = -1; // node the calling thread was pinned to, -1 if it was not
+
+// Per node copy of the target image, replaced (never freed, readers may still hold it) when input.pixel changes
+struct Replica {
+    const unsigned char *src;
+    unsigned char *copy;
+};
+static std::atomic<Replica *> replicas[NUMA_MAX_NODES];
+static std::mutex replica_mutex;
+
+// Parses a sysfs cpu list such as "0-3,8-11"
+static int parse_cpulist(const char *path, int *out) {
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    int n = 0, a, b;
+    char sep;
+    while (fscanf(f, "%d", &a) == 1) {
+        b = a;
+        if (fscanf(f, "%c", &sep) == 1 && sep == '-') {
+            if (fscanf(f, "%d", &b) != 1) break;
+            if (fscanf(f, "%c", &sep) != 1) sep = 0;
+        }
+        for (int c = a; c <= b && n < CPU_SETSIZE; c++) out[n++] = c;
+        if (sep != ',') break;
+    }
+    fclose(f);
+    return n;
+}
+
+void numa_setup(bool numa, bool huge) {
+    pinning = numa;
+    huge_pages = huge;
+    if (!numa) return;
+
+    // Cores of every node
+    static int node_cpus[NUMA_MAX_NODES][CPU_SETSIZE];
+    int count[NUMA_MAX_NODES] = {}, most = 0;
+    n_nodes = 0;
+    for (int node = 0; node < NUMA_MAX_NODES; node++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        count[n_nodes] = parse_cpulist(path, node_cpus[n_nodes]);
+        if (count[n_nodes] > 0) most = std::max(most, count[n_nodes++]);
+    }
+    if (!n_nodes) { // no sysfs: a single node with every core
+        n_nodes = 1;
+        most = count[0] = (int) std::thread::hardware_concurrency();
+        for (int c = 0; c < most; c++) node_cpus[0][c] = c;
+    }
+
+    // Round-robin over the nodes, so that consecutive workers land on different sockets
+    n_cpus = 0;
+    for (int i = 0; i < most; i++) {
+        for (int node = 0; node < n_nodes; node++) {
+            if (i >= count[node]) continue;
+            cpus[n_cpus] = node_cpus[node][i];
+            cpu_node[n_cpus++] = node;
+        }
+    }
+    printf("NUMA: %d node(s), %d core(s)%s\n", n_nodes, n_cpus, huge ? ", huge pages" : "");
+}
+
+int numa_nodes() {
+    return n_nodes;
+}
+
+void numa_pin(int worker) {
+    if (!pinning || !n_cpus) return;
+    int k = worker % n_cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpus[k], &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0) my_node = cpu_node[k];
+}
+
+// Rounded size of a buffer of the given bytes
+static size_t alloc_size(size_t bytes) {
+    return huge_pages ? (bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE : bytes;
+}
+
+void *numa_alloc(size_t bytes) {
+    size_t size = alloc_size(bytes);
+    void *p = MAP_FAILED;
+    if (huge_pages) p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p == MAP_FAILED) {
+        p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) throw std::bad_alloc();
+        if (huge_pages) madvise(p, size, MADV_HUGEPAGE);
+    }
+    return p;
+}
+
+// Binds the pages of a buffer from numa_alloc (not touched yet) to node, they land there whoever touches them first
+static void bind_to(void *p, size_t bytes, int node) {
+    unsigned long mask[NUMA_MAX_NODES / (8 * sizeof(long)) + 1] = {};
+    mask[node / (8 * sizeof(long))] |= 1UL << node % (8 * sizeof(long));
+    syscall(SYS_mbind, p, alloc_size(bytes), MPOL_PREFERRED, mask, NUMA_MAX_NODES + 1, 0); // first touch otherwise
+}
+
+void numa_free(void *p, size_t bytes) {
+    if (p) munmap(p, alloc_size(bytes));
+}
+
+static size_t window_bytes() {
+    return sizeof(unsigned char) * input.width * input.height * channels;
+}
+
+Chromosome *numa_chromosome(const Chromosome *init) {
+    Chromosome *c = new(numa_alloc(sizeof(Chromosome))) Chromosome();
+    free(c->window);
+    c->mapped = window_bytes();
+    c->window = (unsigned char *) numa_alloc(c->mapped);
+    memset(c->window, 0, c->mapped); // first touch, from the calling thread
+    if (init) c->copy_from(*init);
+    return c;
+}
+
+int numa_node() {
+    return my_node < 0 ? 0 : my_node;
+}
+
+void numa_window(Chromosome &c, int node) {
+    if (n_nodes < 2) return;
+    unsigned char *w = (unsigned char *) numa_alloc(window_bytes());
+    bind_to(w, window_bytes(), node);
+    memset(w, 0, window_bytes());
+    if (c.mapped) numa_free(c.window, c.mapped);
+    else free(c.window);
+    c.window = w;
+    c.mapped = window_bytes();
+    c.home = node;
+}
+
+void numa_release(Chromosome *c) {
+    if (!c) return;
+    numa_free(c->window, c->mapped); // the resolution may have changed since it was mapped
+    c->~Chromosome(); // the lists of its grid
+    numa_free(c, sizeof(Chromosome));
+}
+
+const unsigned char *target_pixels() {
+    if (my_node < 0 || n_nodes < 2) return input.pixel;
+    Replica *r = replicas[my_node].load(std::memory_order_acquire);
+    if (r && r->src == input.pixel) return r->copy;
+
+    // First worker of this node to score against this input makes the replica, touching it first
+    std::lock_guard<std::mutex> lock(replica_mutex);
+    r = replicas[my_node].load(std::memory_order_acquire);
+    if (r && r->src == input.pixel) return r->copy;
+    Replica *fresh = new Replica{input.pixel, (unsigned char *) numa_alloc(window_bytes())};
+    memcpy(fresh->copy, input.pixel, window_bytes());
+    replicas[my_node].store(fresh, std::memory_order_release);
+    return fresh->copy;
+}
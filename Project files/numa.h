@@ -0,0 +1,48 @@
+/*
+ * NUMA-aware placement for the background workers
+ * With --numa, every worker thread is pinned to its own core (cores are interleaved across the nodes so that every
+ * socket gets its share of workers), allocates its genomes and framebuffers itself so that first touch puts them on
+ * its node, and reads the target image from a replica on its node. With --hugepages, those buffers are backed by huge
+ * pages when the system has some to give (explicit ones first, transparent ones otherwise).
+ * The topology comes from /sys/devices/system/node, no library is needed; without --numa everything falls back to the
+ * plain shared buffers.
+ */
+
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <cstddef>
+
+#define NUMA_MAX_NODES 16
+#define HUGE_PAGE (2 << 20) // Size huge page backed buffers are rounded up to
+
+struct Chromosome;
+
+// Reads the topology and enables pinning/replicas (numa) and huge page buffers (huge)
+void numa_setup(bool numa, bool huge);
+
+// Number of memory nodes found by numa_setup (1 if it was not called)
+int numa_nodes();
+
+// Pins the calling thread to the core of the given worker (0 is the main thread), no-op without --numa
+void numa_pin(int worker);
+
+// Page aligned buffer, on huge pages if enabled; not touched, so its pages land on the node of the first writer
+void *numa_alloc(size_t bytes);
+void numa_free(void *p, size_t bytes); // bytes: the size given to numa_alloc, whatever the resolution is now
+
+// Node the calling thread was pinned to, 0 if it was not
+int numa_node();
+
+// New chromosome whose genome and window live on the node of the calling thread, a copy of init if given
+Chromosome *numa_chromosome(const Chromosome *init);
+void numa_release(Chromosome *c);
+
+// Moves the window of c (a population member or a child) to the given node, whoever writes it first; c.home tells
+// where it went. No-op on a single node
+void numa_window(Chromosome &c, int node);
+
+// Target image pixels to score against: the replica on the node of the calling thread, or input.pixel
+const unsigned char *target_pixels();
+
+#endif // NUMA_H
@@ -0,0 +1,70 @@
+/*
+ * Adaptive operator selection, see operators.h
+ */
+
+#include "operators.h"
+#include <cstdlib>
+#include <ctime>
+#include <algorithm>
+
+// Starts from the hand-picked mix: 95% crossover split evenly between one-point and n-points, the rest mostly disturb
+// (complete change is raised from 0.25% to OP_FLOOR so that it gets measured)
+OperatorStats op_stats[OP_COUNT] = {{0.465, 0, 0, 0, 0, 0}, {0.465, 0, 0, 0, 0, 0}, {0.05, 0, 0, 0, 0, 0},
+                                    {OP_FLOOR, 0, 0, 0, 0, 0}};
+const char *op_names[OP_COUNT] = {"one-point", "n-points", "disturb", "change"};
+
+void op_set_mix(double crossover, double one_point, double disturb) {
+    double p[OP_COUNT] = {crossover * one_point, crossover * (1 - one_point),
+                          (1 - crossover) * disturb, (1 - crossover) * (1 - disturb)};
+    double total = 0;
+    for (double &x : p) total += x = std::max(x, OP_FLOOR);
+    for (int i = 0; i < OP_COUNT; i++) op_stats[i].prob = p[i] / total;
+}
+
+int op_pick(unsigned int &seed) {
+    double r = (double) rand_r(&seed) / RAND_MAX;
+    for (int i = 0; i < OP_COUNT - 1; i++) {
+        if (r < op_stats[i].prob) return i;
+        r -= op_stats[i].prob;
+    }
+    return OP_COUNT - 1;
+}
+
+void op_record(int op, double reward, double seconds) {
+    OperatorStats &s = op_stats[op];
+    double w = s.uses ? OP_DECAY : 1.0;
+    s.reward += w * (reward - s.reward);
+    s.cost += w * (seconds - s.cost);
+    s.uses++;
+    s.seconds += seconds;
+    if (reward > 0) s.successes++;
+}
+
+void op_update() {
+    double value[OP_COUNT], total = 0;
+    for (int i = 0; i < OP_COUNT; i++) {
+        if (op_stats[i].uses < OP_WARMUP) return;
+        value[i] = op_stats[i].cost > 0 ? op_stats[i].reward / op_stats[i].cost : 0;
+        total += value[i];
+    }
+    if (total <= 0) return;
+    for (int i = 0; i < OP_COUNT; i++) {
+        double target = OP_FLOOR + (1 - OP_COUNT * OP_FLOOR) * value[i] / total;
+        op_stats[i].prob += OP_RATE * (target - op_stats[i].prob);
+    }
+}
+
+void op_print(FILE *out) {
+    for (int i = 0; i < OP_COUNT; i++) {
+        const OperatorStats &s = op_stats[i];
+        fprintf(out, "  %-9s p=%.3f uses=%ld success=%.2f%% improvement/cpu-s=%.3g cost=%.2fms\n",
+                op_names[i], s.prob, s.uses, s.uses ? 100.0 * s.successes / s.uses : 0.0,
+                s.cost > 0 ? s.reward / s.cost : 0.0, 1000 * s.cost);
+    }
+}
+
+double thread_seconds() {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
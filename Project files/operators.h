@@ -0,0 +1,52 @@
+/*
+ * Adaptive operator selection
+ * Every child of gl_idle is produced by one of four operators. Each operator keeps moving averages of the improvement
+ * its children bring and of the CPU time they cost (operator plus fitness evaluation). Once per generation, the
+ * probabilities are pulled towards the operators with the best improvement per CPU-second (adaptive pursuit bandit),
+ * with a floor so that no operator stops being measured.
+ */
+
+#ifndef OPERATORS_H
+#define OPERATORS_H
+
+#include <cstdio>
+
+enum Operator { OP_ONE_POINT, OP_N_POINTS, OP_DISTURB, OP_CHANGE, OP_COUNT };
+
+#define OP_FLOOR 0.02  // Minimum probability of every operator
+#define OP_DECAY 0.02  // Weight of the newest sample in the moving averages
+#define OP_RATE 0.1    // How fast probabilities move towards the current best operator mix, per generation
+#define OP_WARMUP 20   // Samples every operator needs before probabilities start adapting
+
+struct OperatorStats {
+    double prob;      // probability to be picked for the next child
+    double reward;    // moving average of the improvement of its children
+    double cost;      // moving average of CPU seconds per child
+    long uses;        // children produced
+    long successes;   // children that made it into the elites
+    double seconds;   // total CPU seconds spent
+};
+
+extern OperatorStats op_stats[OP_COUNT];
+extern const char *op_names[OP_COUNT];
+
+// Resets the probabilities from the three knobs of the original hand-picked mix: share of crossover, share of
+// one-point among crossovers and share of disturb among mutations (every probability is kept above OP_FLOOR)
+void op_set_mix(double crossover, double one_point, double disturb);
+
+// Picks the operator for the next child
+int op_pick(unsigned int &seed);
+
+// Records one child of operator op: its relative improvement over the elite cut (0 if none) and its CPU cost
+void op_record(int op, double reward, double seconds);
+
+// Moves the probabilities towards the best improvement per CPU-second, called once per generation
+void op_update();
+
+// Per operator metrics: probability, uses, success rate, improvement rate and average cost
+void op_print(FILE *out);
+
+// CPU time consumed by the calling thread, in seconds
+double thread_seconds();
+
+#endif // OPERATORS_H
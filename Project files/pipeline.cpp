@@ -0,0 +1,139 @@
+/*
+ * Breeding pipeline of a generation, see pipeline.h
+ */
+
+#include "pipeline.h"
+#include "chromosome.h"
+#include "mpmc.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+static MpmcQueue<int, PIPELINE_QUEUE> eval_queue[NUMA_MAX_NODES]; // bred children waiting to be scored, by node
+static MpmcQueue<int, PIPELINE_QUEUE> done_queue; // scored (or skipped, as ~slot) children waiting for selection
+
+// A run starts with at most slack <= POP_SIZE children pending and adds at most POP_SIZE, and a pending child sits in
+// one queue at most, so no queue can ever hold more than twice POP_SIZE entries
+static_assert(PIPELINE_QUEUE >= 2 * POP_SIZE, "the pipeline queues must hold every pending child");
+
+static std::thread *helpers = nullptr;
+static int n_helpers = 0;
+static std::mutex m;
+static std::condition_variable cv;
+static long generation = 0; // bumped by every pipeline_run, wakes the helpers
+static bool stopping = false;
+static PipelineStages stages_now;
+
+// Slots left to breed in the current run, as (last << 32 | next) so that a claim is a single compare-and-swap
+// and a late helper can never mix the bounds of two runs
+static std::atomic<unsigned long long> claims(0);
+static std::atomic<int> bred(0); // breed stages finished in the current run
+static int pending = 0;          // done() calls still owed, only touched by the caller of pipeline_run
+
+// Claims the next slot to breed, false when the run has none left
+static bool claim(int &slot) {
+    unsigned long long c = claims.load();
+    while ((unsigned) c < c >> 32)
+        if (claims.compare_exchange_weak(c, c + 1)) {
+            slot = (int) (unsigned) c;
+            return true;
+        }
+    return false;
+}
+
+// Queues a slot. A failed push would lose the child and leave pipeline_run waiting for it forever: as the queues cannot
+// fill up (see above), it means the bookkeeping is broken, so it fails loudly
+static void push(MpmcQueue<int, PIPELINE_QUEUE> &q, int slot) {
+    if (q.push(slot)) return;
+    fprintf(stderr, "Pipeline: queue full, the child of slot %d is lost\n", slot < 0 ? ~slot : slot);
+    abort();
+}
+
+// Takes a child to score, from the queue of the node of the calling thread first
+static bool pop_eval(int &slot) {
+    int nodes = numa_nodes(), mine = numa_node();
+    for (int i = 0; i < nodes; i++)
+        if (eval_queue[(mine + i) % nodes].pop(slot)) return true;
+    return false;
+}
+
+// Does one piece of work, scoring before breeding so children do not pile up; false when there is none
+static bool step() {
+    int slot;
+    if (pop_eval(slot)) {
+        stages_now.score(slot);
+        push(done_queue, slot);
+        return true;
+    }
+    if (!claim(slot)) return false;
+    if (stages_now.breed(slot)) push(eval_queue[stages_now.node ? stages_now.node(slot) % numa_nodes() : 0], slot);
+    else push(done_queue, ~slot);
+    bred++;
+    return true;
+}
+
+static void helper(int worker, unsigned int base_seed) {
+    numa_pin(worker);
+    seed = base_seed; // the breeding operators draw from the thread local seed
+    long seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m);
+            cv.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+        while (step()) {}
+    }
+}
+
+void pipeline_start(int workers, const PipelineStages &stages) {
+    if (helpers) return;
+    stages_now = stages;
+    if (workers < 1) return;
+    stopping = false;
+    n_helpers = workers;
+    helpers = new std::thread[n_helpers];
+    for (int i = 0; i < n_helpers; i++) helpers[i] = std::thread(helper, i + 1, seed * 2654435761u + i + 1);
+}
+
+void pipeline_stop() {
+    if (!helpers) return;
+    {
+        std::lock_guard<std::mutex> lock(m);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (int i = 0; i < n_helpers; i++) helpers[i].join();
+    delete[] helpers;
+    helpers = nullptr;
+    n_helpers = 0;
+}
+
+void pipeline_run(int first, int last, int slack) {
+    int n = std::max(0, last - first);
+    pending += n;
+    bred = 0;
+    claims = (unsigned long long) last << 32 | (unsigned) first;
+    {
+        std::lock_guard<std::mutex> lock(m);
+        generation++;
+    }
+    cv.notify_all();
+
+    // The caller works too, and is the only one running selection (done)
+    while (bred < n || pending > slack) {
+        int slot;
+        if (done_queue.pop(slot)) {
+            stages_now.done(slot >= 0 ? slot : ~slot, slot < 0);
+            pending--;
+        } else if (!step()) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+int pipeline_pending() {
+    return pending;
+}
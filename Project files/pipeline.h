@@ -0,0 +1,41 @@
+/*
+ * Breeding pipeline of a generation
+ * Children go through two stages: breed (crossover or mutation, cheap) and score (render and fitness, expensive).
+ * Bred children are pushed to a lock-free evaluation queue, scored children to a lock-free completion queue drained
+ * by the thread that runs the generation (the only one doing selection). Every thread, the caller included, takes
+ * whatever work is available: scoring first, breeding otherwise, so no thread waits on another stage.
+ *
+ * Generations can overlap: a run may return while up to 'slack' children (of this run or of earlier ones) are still
+ * being scored, so the cores go on with the next generation instead of waiting for the stragglers at a barrier.
+ * Their completion is reported by a later run. Breeding always finishes within its run, so the population the
+ * children are bred from may change as soon as a run returns; only the scoring stage outlives it.
+ * With several NUMA nodes, every node has its own evaluation queue: a child is scored by a thread of the node its
+ * window lives on, unless all of them are busy and a thread of another node steals it.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#define PIPELINE_QUEUE 256 // Capacity of the queues, at least twice POP_SIZE (stragglers and a full generation)
+
+struct PipelineStages {
+    bool (*breed)(int slot);               // creates the child of slot, false to skip it (nothing to score)
+    void (*score)(int slot);               // evaluates the child of slot
+    void (*done)(int slot, bool skipped);  // called on the calling thread of pipeline_run for every child
+    int (*node)(int slot);                 // NUMA node whose threads should score slot, nullptr for any
+};
+
+// Starts the given number of helper threads (0 runs every stage on the calling thread)
+void pipeline_start(int workers, const PipelineStages &stages);
+
+// Stops and joins the helpers, safe to call more than once. Stragglers are left queued for the next start
+void pipeline_stop();
+
+// Breeds and scores the children of slots [first, last), returns once done() was called for all of them but at most
+// slack (counting the stragglers of earlier runs)
+void pipeline_run(int first, int last, int slack);
+
+// Number of children bred but not reported by done() yet
+int pipeline_pending();
+
+#endif // PIPELINE_H
@@ -0,0 +1,139 @@
+/*
+ * Memetic local search of the elites on otherwise idle threads, see polish.h
+ */
+
+#include "polish.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <pthread.h>
+
+enum SlotState { IDLE, BUSY, DONE };
+
+// One worker and the elite it is currently working on
+struct PolishSlot {
+    std::mutex m;
+    std::condition_variable cv;
+    std::thread thread;
+    Chromosome *work{};      // private copy being polished, owned by the worker while BUSY, allocated on its node
+    unsigned long src_id{};  // id and fitness of the population member it was copied from
+    ll src_fit{};
+    SlotState state = BUSY;  // until the worker has allocated its buffers
+    std::atomic<bool> stop{false};
+};
+
+static PolishSlot *slots = nullptr;
+static int n_slots = 0;
+static int next_elite = 0; // elites are handed out round-robin
+
+// Coordinate-wise local search: nudge one vertex coordinate both ways, keep whichever direction helps
+// A mesh vertex is shared, the area to re-render is then the one of every triangle using it
+static void polish(Chromosome &c, unsigned char *scratch, unsigned int &seed, const std::atomic<bool> &stop) {
+    for (int step = 0; step < POLISH_STEPS && !stop; step++) {
+        int t = rand_r(&seed) % params.triangles, v = rand_r(&seed) % V, axis = rand_r(&seed) % 2;
+        if (params.mesh) v = c.index[t][v];
+        double old = params.mesh ? c.vertex[v][axis] : c.point[t][v][axis];
+        double delta = RND / 50;
+        Rect before = c.corner_rect(t, v);
+
+        for (int dir = 1; dir >= -1; dir -= 2) {
+            double moved = old + dir * delta;
+            if (moved < 0 || moved > 1) continue;
+            c.set_coordinate(t, v, axis, moved);
+            c.reindex_corner(t, v);
+            Rect r = rect_union(before, c.corner_rect(t, v));
+            ll d = c.rescore(r, scratch);
+            if (d < 0) {
+                c.commit(r, scratch, d);
+                old = moved;
+                break;
+            }
+        }
+        c.set_coordinate(t, v, axis, old);
+        c.reindex_corner(t, v);
+    }
+}
+
+static void polish_worker(PolishSlot *s, int worker, unsigned int seed) {
+    // Pinned first, so that the buffers below are first touched (hence placed) on the node of the worker
+    numa_pin(worker);
+    // The breeding pipeline shares these cores, polishing only gets the time it leaves idle
+    sched_param idle{};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &idle);
+    size_t bytes = sizeof(unsigned char) * input.width * input.height * channels;
+    unsigned char *scratch = (unsigned char *) numa_alloc(bytes);
+    memset(scratch, 0, bytes);
+    std::unique_lock<std::mutex> lock(s->m);
+    s->work = numa_chromosome(nullptr);
+    s->state = IDLE;
+    while (true) {
+        s->cv.wait(lock, [s] { return s->stop || s->state == BUSY; });
+        if (s->stop) break;
+        lock.unlock();
+        polish(*s->work, scratch, seed, s->stop);
+        lock.lock();
+        s->state = DONE;
+    }
+    numa_release(s->work);
+    numa_free(scratch, bytes);
+}
+
+void polish_start(int workers) {
+    // Polishing scores dirty rectangles of the whole image and moves any triangle, a region of interest allows neither
+    if (workers < 1 || slots || roi_count) return;
+    n_slots = workers;
+    slots = new PolishSlot[n_slots];
+    for (int i = 0; i < n_slots; i++) slots[i].thread = std::thread(polish_worker, &slots[i], i + 1, seed + i + 1);
+}
+
+void polish_stop() {
+    for (int i = 0; i < n_slots; i++) {
+        {
+            std::lock_guard<std::mutex> lock(slots[i].m);
+            slots[i].stop = true;
+        }
+        slots[i].cv.notify_one();
+        slots[i].thread.join();
+    }
+    delete[] slots;
+    slots = nullptr;
+    n_slots = 0;
+}
+
+void polish_collect(Chromosome *pop, int size) {
+    for (int i = 0; i < n_slots; i++) {
+        PolishSlot &s = slots[i];
+        std::unique_lock<std::mutex> lock(s.m, std::try_to_lock);
+        if (!lock.owns_lock() || s.state != DONE) continue;
+        s.state = IDLE;
+        if (s.work->fit_val >= s.src_fit) continue;
+
+        // Replace the source if it survived unchanged, otherwise the polished copy takes the place of the worst member
+        // Either way it is a new genome, so it gets a new id (two members sharing one would confuse the next match)
+        int target = -1, worst = 0;
+        for (int j = 0; j < size; j++) {
+            if (pop[j].id == s.src_id && pop[j].fit_val == s.src_fit) target = j;
+            if (pop[j].fit_val > pop[worst].fit_val) worst = j;
+        }
+        if (target < 0 && pop[worst].fit_val > s.work->fit_val) target = worst;
+        if (target < 0) continue;
+        pop[target].copy_from(*s.work);
+        pop[target].id = ++next_id;
+    }
+}
+
+void polish_dispatch(const Chromosome *pop, int elites) {
+    for (int i = 0; i < n_slots; i++) {
+        PolishSlot &s = slots[i];
+        std::unique_lock<std::mutex> lock(s.m, std::try_to_lock);
+        if (!lock.owns_lock() || s.state != IDLE) continue;
+        const Chromosome &e = pop[next_elite++ % elites];
+        s.work->copy_from(e);
+        s.src_id = e.id;
+        s.src_fit = e.fit_val;
+        s.state = BUSY;
+        lock.unlock();
+        s.cv.notify_one();
+    }
+}
@@ -0,0 +1,27 @@
+/*
+ * Memetic local search: background workers that polish copies of the elites while the main loop breeds the next
+ * generation. A worker nudges one vertex coordinate at a time and keeps the move only if the incremental score improves.
+ * Workers run at idle priority: they share their cores with the breeding pipeline and only get the time it leaves.
+ * Results are written back by the main thread at a generation boundary, so the population is never seen half-updated.
+ */
+
+#ifndef POLISH_H
+#define POLISH_H
+
+#include "chromosome.h"
+
+#define POLISH_STEPS 100 // Vertex nudges tried on an elite before it is handed back
+
+// Starts the given number of polish workers (none if workers < 1)
+void polish_start(int workers);
+
+// Stops and joins the workers (work in progress is dropped), safe to call more than once
+void polish_stop();
+
+// Generation boundary, before sorting: writes finished and improved elites back into pop
+void polish_collect(Chromosome *pop, int size);
+
+// Generation boundary, after sorting: hands the best `elites` chromosomes of pop to the idle workers
+void polish_dispatch(const Chromosome *pop, int elites);
+
+#endif // POLISH_H
@@ -0,0 +1,176 @@
+/*
+ * Software rasterizer used for fitness evaluation, see raster.h
+ * render_rect and rect_error are in engine.cpp, they run the engine picked by engine_select
+ */
+
+#include "raster.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+int channels = 3;
+
+Rect rect_union(const Rect &a, const Rect &b) {
+    if (a.empty()) return b;
+    if (b.empty()) return a;
+    return {std::min(a.x0, b.x0), std::min(a.y0, b.y0), std::max(a.x1, b.x1), std::max(a.y1, b.y1)};
+}
+
+Rect tri_bounds(const double p[3][2], int w, int h) {
+    double min_x = std::min(p[0][0], std::min(p[1][0], p[2][0])) * w;
+    double max_x = std::max(p[0][0], std::max(p[1][0], p[2][0])) * w;
+    double min_y = std::min(p[0][1], std::min(p[1][1], p[2][1])) * h;
+    double max_y = std::max(p[0][1], std::max(p[1][1], p[2][1])) * h;
+    return {std::max(0, (int) floor(min_x)), std::max(0, (int) floor(min_y)),
+            std::min(w, (int) ceil(max_x)), std::min(h, (int) ceil(max_y))};
+}
+
+Rect shape_bounds(const double p[3][2], int shape, int w, int h) {
+    if (shape == SHAPE_TRIANGLE) return tri_bounds(p, w, h);
+    double min_x, max_x, min_y, max_y;
+    if (shape == SHAPE_QUAD) {
+        double qx = p[1][0] + p[2][0] - p[0][0], qy = p[1][1] + p[2][1] - p[0][1];
+        min_x = std::min(std::min(p[0][0], p[1][0]), std::min(p[2][0], qx)) * w;
+        max_x = std::max(std::max(p[0][0], p[1][0]), std::max(p[2][0], qx)) * w;
+        min_y = std::min(std::min(p[0][1], p[1][1]), std::min(p[2][1], qy)) * h;
+        max_y = std::max(std::max(p[0][1], p[1][1]), std::max(p[2][1], qy)) * h;
+    } else {
+        double rx = fabs(p[1][0] - p[0][0]) * w, ry = fabs(p[1][1] - p[0][1]) * h;
+        if (shape == SHAPE_CIRCLE) rx = ry = hypot(rx, ry);
+        min_x = p[0][0] * w - rx;
+        max_x = p[0][0] * w + rx;
+        min_y = p[0][1] * h - ry;
+        max_y = p[0][1] * h + ry;
+    }
+    return {std::max(0, (int) floor(min_x)), std::max(0, (int) floor(min_y)),
+            std::min(w, (int) ceil(max_x)), std::min(h, (int) ceil(max_y))};
+}
+
+bool grid_cells(const Rect &r, int w, int h, int &cx0, int &cy0, int &cx1, int &cy1) {
+    if (r.empty()) return false;
+    cx0 = r.x0 * GRID / w;
+    cy0 = r.y0 * GRID / h;
+    cx1 = (r.x1 - 1) * GRID / w;
+    cy1 = (r.y1 - 1) * GRID / h;
+    return true;
+}
+
+Rect grid_band(int cy, int w, int h) {
+    // Pixel y is in band y * GRID / h, so band cy starts at the first y with y * GRID >= cy * h
+    return {0, (cy * h + GRID - 1) / GRID, w, ((cy + 1) * h + GRID - 1) / GRID};
+}
+
+// Cells of a primitive, packed as cx0 | cy0 << 8 | cx1 << 16 | cy1 << 24 (GRID_NONE if it covers no pixel)
+static unsigned int cells_of(const double p[3][2], int shape, int w, int h) {
+    int cx0, cy0, cx1, cy1;
+    if (!grid_cells(shape_bounds(p, shape, w, h), w, h, cx0, cy0, cx1, cy1)) return GRID_NONE;
+    return cx0 | cy0 << 8 | cx1 << 16 | (unsigned int) cy1 << 24;
+}
+
+static bool in_cells(unsigned int at, int x, int y) {
+    return at != GRID_NONE && x >= (int) (at & 0xff) && y >= (int) (at >> 8 & 0xff) && x <= (int) (at >> 16 & 0xff) &&
+           y <= (int) (at >> 24);
+}
+
+void grid_build(Grid &g, const double (*point)[3][2], const unsigned char *shape, int n, int w, int h) {
+    g.at.resize(n);
+    g.w = w;
+    g.h = h;
+    memset(g.count, 0, sizeof(g.count));
+    for (int t = 0; t < n; t++) {
+        unsigned int at = g.at[t] = cells_of(point[t], shape[t], w, h);
+        if (at == GRID_NONE) continue;
+        for (int y = at >> 8 & 0xff; y <= (int) (at >> 24); y++)
+            for (int x = at & 0xff; x <= (int) (at >> 16 & 0xff); x++) g.count[y * GRID + x]++;
+    }
+
+    // Lay the lists out with room to grow, then fill them in order
+    unsigned int total = 0;
+    for (int c = 0; c < GRID * GRID; c++) {
+        g.start[c] = total;
+        g.room[c] = g.count[c] + g.count[c] / 2 + GRID_ROOM;
+        total += g.room[c];
+        g.count[c] = 0;
+    }
+    if (g.pool.size() < total) g.pool.resize(total + total / 2);
+    for (int t = 0; t < n; t++) {
+        unsigned int at = g.at[t];
+        if (at == GRID_NONE) continue;
+        for (int y = at >> 8 & 0xff; y <= (int) (at >> 24); y++)
+            for (int x = at & 0xff; x <= (int) (at >> 16 & 0xff); x++) {
+                int c = y * GRID + x;
+                g.pool[g.start[c] + g.count[c]++] = t;
+            }
+    }
+}
+
+void grid_update(Grid &g, int t, const double (*point)[3][2], const unsigned char *shape, int n, int w, int h) {
+    if (g.w != w || g.h != h || (int) g.at.size() != n) return; // not built for this canvas, grid_sync will
+    unsigned int was = g.at[t], now = cells_of(point[t], shape[t], w, h);
+    if (was == now) return;
+
+    // A list that is out of room makes the pool be laid out again, with the new cells of t
+    if (now != GRID_NONE)
+        for (int y = now >> 8 & 0xff; y <= (int) (now >> 24); y++)
+            for (int x = now & 0xff; x <= (int) (now >> 16 & 0xff); x++)
+                if (!in_cells(was, x, y) && g.count[y * GRID + x] == g.room[y * GRID + x]) {
+                    grid_build(g, point, shape, n, w, h);
+                    return;
+                }
+
+    // The lists stay sorted, so that a render blends in the order of the genome
+    g.at[t] = now;
+    if (was != GRID_NONE)
+        for (int y = was >> 8 & 0xff; y <= (int) (was >> 24); y++)
+            for (int x = was & 0xff; x <= (int) (was >> 16 & 0xff); x++) {
+                if (in_cells(now, x, y)) continue;
+                int c = y * GRID + x;
+                unsigned short *l = g.pool.data() + g.start[c], *end = l + g.count[c]--;
+                unsigned short *i = std::lower_bound(l, end, t);
+                memmove(i, i + 1, (end - i - 1) * sizeof(*i));
+            }
+    if (now != GRID_NONE)
+        for (int y = now >> 8 & 0xff; y <= (int) (now >> 24); y++)
+            for (int x = now & 0xff; x <= (int) (now >> 16 & 0xff); x++) {
+                if (in_cells(was, x, y)) continue;
+                int c = y * GRID + x;
+                unsigned short *l = g.pool.data() + g.start[c], *end = l + g.count[c]++;
+                unsigned short *i = std::lower_bound(l, end, t);
+                memmove(i + 1, i, (end - i) * sizeof(*i));
+                *i = t;
+            }
+}
+
+void grid_sync(Grid &g, const double (*point)[3][2], const unsigned char *shape, int n, int w, int h) {
+    if (g.w != w || g.h != h || (int) g.at.size() != n) {
+        grid_build(g, point, shape, n, w, h);
+        return;
+    }
+    // A new genome (crossover, a copy of another one) moved most of its primitives, it is faster to start over
+    int moved = 0;
+    for (int t = 0; t < n; t++)
+        if (cells_of(point[t], shape[t], w, h) != g.at[t] && ++moved > n / GRID_REBUILD) {
+            grid_build(g, point, shape, n, w, h);
+            return;
+        }
+    for (int t = 0; t < n && moved; t++) grid_update(g, t, point, shape, n, w, h);
+}
+
+void grid_copy(Grid &dst, const Grid &src) {
+    unsigned int used = src.start[GRID * GRID - 1] + src.room[GRID * GRID - 1];
+    if (dst.pool.size() < used) dst.pool.resize(used + used / 2);
+    if (used) memcpy(dst.pool.data(), src.pool.data(), used * sizeof(src.pool[0]));
+    memcpy(dst.start, src.start, sizeof(src.start));
+    memcpy(dst.count, src.count, sizeof(src.count));
+    memcpy(dst.room, src.room, sizeof(src.room));
+    dst.at.assign(src.at.begin(), src.at.end());
+    dst.w = src.w;
+    dst.h = src.h;
+}
+
+void copy_rect(const unsigned char *src, unsigned char *dst, int w, const Rect &r) {
+    for (int y = r.y0; y < r.y1; y++) {
+        ll off = ((ll) y * w + r.x0) * channels;
+        memcpy(dst + off, src + off, (r.x1 - r.x0) * channels);
+    }
+}
@@ -0,0 +1,106 @@
+/*
+ * Software rasterizer used for fitness evaluation
+ *
+ * Triangles are given in the same normalized [0, 1] coordinates used by the OpenGL display (origin at the bottom-left,
+ * like gluOrtho2D(0, 1, 0, 1) and like the rows of a bottom-up BMP), and are alpha blended in order into a tightly
+ * packed RGB (or gray, see channels) framebuffer, the same way glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA) does.
+ * Unlike OpenGL, these functions need no context, so any thread may call them.
+ * Rendering and scoring are done by the engine selected with engine_select (see engine.h).
+ */
+
+#ifndef RASTER_H
+#define RASTER_H
+
+#include <vector>
+
+typedef long long ll;
+
+// Hot kernels are compiled once per instruction set below, the loader picks the best one the CPU supports
+// (compile.sh targets SSE3, so without this AVX2 and AVX-512 would be left unused on newer machines)
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__)
+#define MULTIVERSION __attribute__((target_clones("arch=x86-64-v4", "arch=x86-64-v3", "default")))
+#else
+#define MULTIVERSION
+#endif
+
+// Bytes per pixel of every buffer given to these functions: 3 (RGB), or 1 for grayscale targets (see engine_select)
+extern int channels;
+
+// Primitive types, all encoded with the three points of a genome entry:
+enum Shape {
+    SHAPE_TRIANGLE, // the three vertices
+    SHAPE_ELLIPSE,  // axis-aligned: center p[0], radii |p[1].x - p[0].x| and |p[1].y - p[0].y|, p[2] unused
+    SHAPE_CIRCLE,   // center p[0], radius |p[1] - p[0]| (in pixels), p[2] unused
+    SHAPE_QUAD,     // parallelogram p[0], p[1], p[1] + p[2] - p[0], p[2], which covers rotated rectangles
+    SHAPE_COUNT
+};
+
+// Half-open pixel rectangle [x0, x1) x [y0, y1)
+struct Rect {
+    int x0, y0, x1, y1;
+
+    bool empty() const { return x0 >= x1 || y0 >= y1; }
+};
+
+// Smallest rectangle containing both a and b
+Rect rect_union(const Rect &a, const Rect &b);
+
+// Spatial index of the primitives of a chromosome: a uniform GRID x GRID grid over the canvas, every cell listing the
+// primitives whose bounds overlap it, in their (blending) order. The lists share one pool sized to what they hold,
+// each with some room to grow, and the cells every primitive was listed under are kept, so that an edit only touches
+// the cells the primitive left and entered. A render then visits, band of cells by band of cells, only the primitives
+// listed there
+#define GRID 16                   // Cells per side
+#define GRID_MAX_PRIMITIVES 65536 // Primitives a grid can index (they are listed as unsigned short)
+#define GRID_NONE 0xffffffffu     // Cells of a primitive that covers no pixel
+#define GRID_ROOM 8               // Free entries every list gets on top of half its length, when the pool is laid out
+#define GRID_REBUILD 4            // grid_sync builds again once more than 1 / GRID_REBUILD of the primitives moved
+
+struct Grid {
+    std::vector<unsigned short> pool; // the lists, cell after cell; it only grows, so a grid soon stops allocating
+    unsigned int start[GRID * GRID]{}, count[GRID * GRID]{}, room[GRID * GRID]{}; // list of every cell in the pool
+    std::vector<unsigned int> at; // cells every primitive is listed under, as packed by grid_cells(), or GRID_NONE
+    int w = 0, h = 0;             // canvas the cells were computed for
+
+    const unsigned short *list(int cell) const { return pool.data() + start[cell]; }
+};
+
+// Pixel bounding box of a triangle on a w x h canvas, clipped to the canvas
+Rect tri_bounds(const double p[3][2], int w, int h);
+
+// Pixel bounding box of a primitive of any shape, clipped to the canvas
+Rect shape_bounds(const double p[3][2], int shape, int w, int h);
+
+// Cells overlapped by r, inclusive ranges, false if r is empty
+bool grid_cells(const Rect &r, int w, int h, int &cx0, int &cy0, int &cx1, int &cy1);
+
+// Pixels of the cells of row band cy, across the whole canvas
+Rect grid_band(int cy, int w, int h);
+
+// Indexes the n primitives from scratch (the pool keeps its memory, only growing it allocates)
+void grid_build(Grid &g, const double (*point)[3][2], const unsigned char *shape, int n, int w, int h);
+
+// Re-indexes primitive t after it changed, only touching the cells it left and entered (the whole genome is needed
+// in case a list runs out of room and the pool is laid out again)
+void grid_update(Grid &g, int t, const double (*point)[3][2], const unsigned char *shape, int n, int w, int h);
+
+// Copies src into dst, reusing the pool of dst
+void grid_copy(Grid &dst, const Grid &src);
+
+// Brings the grid up to date with the n primitives, whatever changed since it was last built or updated: only the
+// primitives that moved to other cells are re-indexed, unless so many did that building it again is cheaper
+void grid_sync(Grid &g, const double (*point)[3][2], const unsigned char *shape, int n, int w, int h);
+
+// Clears r in buf (w pixels per row) to black, then blends the n primitives into it, clipped to r
+// With a grid (which must be up to date, see grid_update and grid_sync) only the primitives listed in the cells
+// overlapping r are visited
+void render_rect(const double (*point)[3][2], const unsigned char *shape, const double (*color)[4], int n,
+                 unsigned char *buf, int w, int h, const Rect &r, const Grid *grid = nullptr);
+
+// Error of buf against target inside r, by the metric of the selected engine (sum of squared differences by default)
+ll rect_error(const unsigned char *buf, const unsigned char *target, int w, const Rect &r);
+
+// Copies r from src into dst, both w pixels per row
+void copy_rect(const unsigned char *src, unsigned char *dst, int w, const Rect &r);
+
+#endif // RASTER_H
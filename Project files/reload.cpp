@@ -0,0 +1,131 @@
+/*
+ * Live parameter hot-reload, see reload.h
+ */
+
+#include "reload.h"
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static std::thread watcher;
+static std::atomic<bool> watching(false);
+static std::mutex staged_mutex;
+static Params staged;       // parameters waiting for the next generation boundary
+static bool changed = false;
+static char retarget_path[512]; // image of a staged retarget message
+static bool retarget = false;
+
+static const char *config_path = nullptr, *fifo_path = nullptr;
+
+// Modification time of the configuration file, 0 if it cannot be read
+static time_t config_mtime() {
+    struct stat st{};
+    return config_path && stat(config_path, &st) == 0 ? st.st_mtime : 0;
+}
+
+// Loads the configuration file over the staged parameters
+static void stage_file() {
+    Params p;
+    {
+        std::lock_guard<std::mutex> lock(staged_mutex);
+        p = staged;
+    }
+    if (!load_params(config_path, p)) return; // keep the old values rather than half a broken file
+    std::lock_guard<std::mutex> lock(staged_mutex);
+    staged = p;
+    changed = true;
+}
+
+// One control message: "reload", "retarget [FILE]" or "key=value"
+static void stage_message(char *msg) {
+    msg[strcspn(msg, "\r\n")] = 0;
+    if (!*msg) return;
+    if (!strcmp(msg, "reload")) {
+        if (config_path) stage_file();
+        return;
+    }
+    if (!strncmp(msg, "retarget", 8) && (!msg[8] || msg[8] == ' ')) {
+        std::lock_guard<std::mutex> lock(staged_mutex);
+        snprintf(retarget_path, sizeof(retarget_path), "%s", msg + strspn(msg + 8, " ") + 8);
+        retarget = true;
+        return;
+    }
+    std::lock_guard<std::mutex> lock(staged_mutex);
+    if (set_param(staged, msg)) changed = true;
+    else fprintf(stderr, "Bad control message: %s\n", msg);
+}
+
+static void watch() {
+    time_t mtime = config_mtime();
+    char buf[1024];
+    int len = 0;
+
+    // Opened read-write so that the pipe always has a writer: poll() then waits for data instead of reporting a hang-up
+    // every time the last external writer goes away
+    int fd = fifo_path ? open(fifo_path, O_RDWR | O_NONBLOCK) : -1;
+    while (watching) {
+        pollfd pfd = {fd, POLLIN, 0};
+        if (fd < 0) usleep(RELOAD_POLL_MS * 1000);
+        else if (poll(&pfd, 1, RELOAD_POLL_MS) > 0) {
+            ssize_t n = read(fd, buf + len, sizeof(buf) - 1 - len);
+            if (n > 0) {
+                len += n;
+                buf[len] = 0;
+                char *line = buf, *end;
+                while ((end = strchr(line, '\n'))) {
+                    *end = 0;
+                    stage_message(line);
+                    line = end + 1;
+                }
+                len = (int) strlen(line);
+                memmove(buf, line, len + 1);
+                if (len == sizeof(buf) - 1) len = 0; // overlong line, drop it
+            }
+        }
+
+        time_t now = config_mtime();
+        if (now != mtime) {
+            mtime = now;
+            if (now) stage_file();
+        }
+    }
+    if (fd >= 0) close(fd);
+}
+
+void reload_start(const char *config_file, const char *control_fifo, const Params &current) {
+    if (watching || (!config_file && !control_fifo)) return;
+    config_path = config_file;
+    fifo_path = control_fifo;
+    if (fifo_path && mkfifo(fifo_path, 0600) != 0 && errno != EEXIST) perror(fifo_path);
+    staged = current;
+    watching = true;
+    watcher = std::thread(watch);
+}
+
+void reload_stop() {
+    if (!watching.exchange(false)) return;
+    watcher.join();
+}
+
+bool reload_retarget(char *path, size_t size) {
+    std::unique_lock<std::mutex> lock(staged_mutex, std::try_to_lock);
+    if (!lock.owns_lock() || !retarget) return false;
+    snprintf(path, size, "%s", retarget_path);
+    retarget = false;
+    return true;
+}
+
+bool reload_fetch(Params &p) {
+    std::unique_lock<std::mutex> lock(staged_mutex, std::try_to_lock);
+    if (!lock.owns_lock() || !changed) return false;
+    p = staged;
+    changed = false;
+    return true;
+}
@@ -0,0 +1,30 @@
+/*
+ * Live parameter hot-reload
+ * A watcher thread stages changes coming from the configuration file (reloaded whenever its modification time
+ * changes) and from control messages ("key=value" lines, or "reload", written to a named pipe). The main loop picks
+ * the staged parameters up as a whole at a generation boundary, so a generation never runs with half a change.
+ * A "retarget FILE" message (or just "retarget", for the input image file) stages a new input image the same way,
+ * see retarget.h.
+ */
+
+#ifndef RELOAD_H
+#define RELOAD_H
+
+#include "config.h"
+
+#define RELOAD_POLL_MS 500 // How often the configuration file is checked for changes
+
+// Starts watching config_file and/or control_fifo (either may be null), staged parameters start from current
+void reload_start(const char *config_file, const char *control_fifo, const Params &current);
+
+// Stops the watcher thread, safe to call more than once
+void reload_stop();
+
+// Copies the staged parameters into p if they changed since the last call, returns whether they did
+bool reload_fetch(Params &p);
+
+// Copies the image file of the last retarget message into path (empty for the input image file), returns false if
+// none came since the last call
+bool reload_retarget(char *path, size_t size);
+
+#endif // RELOAD_H
@@ -0,0 +1,59 @@
+/*
+ * Incremental retargeting, see retarget.h
+ */
+
+#include "retarget.h"
+#include <algorithm>
+
+unsigned char *retarget_load(const char *path) {
+    ImageReader image;
+    if (!image.LoadBmpFile(path)) {
+        fprintf(stderr, "Cannot read %s\n", path);
+        return nullptr;
+    }
+    unsigned char *fresh = nullptr;
+    if (image.width != input.width || image.height != input.height)
+        fprintf(stderr, "%s is %ldx%ld, the image being evolved is %ldx%ld\n", path, image.width, image.height,
+                input.width, input.height);
+    else if (image.channels != channels && channels == 1)
+        fprintf(stderr, "%s is in color, the run scores a single channel\n", path);
+    else {
+        long n = input.width * input.height;
+        fresh = new unsigned char[n * channels];
+        for (long i = 0; i < n; i++)
+            for (int k = 0; k < channels; k++)
+                fresh[i * channels + k] = image.pixel[i * image.channels + k % image.channels];
+    }
+    image.Reset();
+    return fresh;
+}
+
+Rect *retarget_diff(const unsigned char *fresh, int &count) {
+    int w = input.width, h = input.height;
+    int cols = (w + RETARGET_TILE - 1) / RETARGET_TILE, rows = (h + RETARGET_TILE - 1) / RETARGET_TILE;
+    Rect *changed = new Rect[cols * rows];
+    count = 0;
+    for (int ty = 0; ty < rows; ty++) {
+        int y0 = ty * RETARGET_TILE, y1 = std::min(h, y0 + RETARGET_TILE);
+        for (int tx = 0; tx < cols; tx++) {
+            int x0 = tx * RETARGET_TILE, x1 = std::min(w, x0 + RETARGET_TILE);
+            bool differs = false;
+            for (int y = y0; y < y1 && !differs; y++) {
+                size_t off = ((size_t) y * w + x0) * channels;
+                differs = memcmp(input.pixel + off, fresh + off, (size_t) (x1 - x0) * channels) != 0;
+            }
+            if (!differs) continue;
+            if (count && changed[count - 1].y0 == y0 && changed[count - 1].x1 == x0) changed[count - 1].x1 = x1;
+            else changed[count++] = {x0, y0, x1, y1};
+        }
+    }
+    return changed;
+}
+
+ll retarget_delta(const Chromosome &c, const unsigned char *old, const unsigned char *fresh, const Rect *changed,
+                  int count) {
+    ll delta = 0;
+    for (int i = 0; i < count; i++)
+        delta += rect_error(c.window, fresh, input.width, changed[i]) - rect_error(c.window, old, input.width, changed[i]);
+    return delta;
+}
@@ -0,0 +1,26 @@
+/*
+ * Incremental retargeting
+ * When the input image is edited while a run goes on (see the "retarget" control message in reload.h), the population
+ * is kept: the renders of the chromosomes do not depend on the target, so only the error of the tiles that changed
+ * has to be computed again, against the old and the new pixels, and evolution resumes right away.
+ */
+
+#ifndef RETARGET_H
+#define RETARGET_H
+
+#include "chromosome.h"
+
+#define RETARGET_TILE 32 // Side of the tiles the old and new images are compared by, in pixels
+
+// Reads path as a replacement for input.pixel: same size, converted to the current channels
+// Returns a new buffer (new[]), or nullptr after printing why the image cannot replace the input
+unsigned char *retarget_load(const char *path);
+
+// Rectangles (runs of tiles along rows) where fresh differs from input.pixel, the caller delete[]s them
+Rect *retarget_diff(const unsigned char *fresh, int &count);
+
+// Fitness change of c when its target goes from old to fresh, both differing only inside the changed rectangles
+ll retarget_delta(const Chromosome &c, const unsigned char *old, const unsigned char *fresh, const Rect *changed,
+                  int count);
+
+#endif // RETARGET_H
@@ -0,0 +1,208 @@
+/*
+ * Region of interest re-evolution, see roi.h
+ */
+
+#include "roi.h"
+#include <algorithm>
+
+const Rect *roi_tiles = nullptr;
+int roi_count = 0;
+
+static bool masked[ROI_TILES][ROI_TILES];   // [row][column] of the tiles in the region
+static bool live[N];                        // triangles of the genome allowed to change
+static double lo[2], hi[2];                 // normalized bounding box of the region, where live triangles are put back
+static int box[4];                          // the same box in tiles: x0, y0, x1, y1
+static const Chromosome *genome = nullptr;
+static Rect tiles[ROI_TILES * ROI_TILES];   // the masked tiles in pixels, a row of them per rect: what roi_tiles holds
+static unsigned char *frozen = nullptr;     // render of the genome at the current resolution
+static long frozen_size = 0;
+
+// Tile of pixel x along a side of size pixels: the tiles start at pixel tile * size / ROI_TILES, see roi_layout()
+static int tile_of(int x, int size) {
+    return ((x + 1) * ROI_TILES - 1) / size;
+}
+
+// Tiles the pixels of primitive p (of the given shape) fall in at the current resolution, false if there are none
+static bool footprint(const double p[3][2], int shape, int &tx0, int &ty0, int &tx1, int &ty1) {
+    int w = input.width, h = input.height;
+    Rect r = shape_bounds(p, shape, w, h);
+    if (r.empty()) return false;
+    tx0 = tile_of(r.x0, w);
+    ty0 = tile_of(r.y0, h);
+    tx1 = tile_of(r.x1 - 1, w);
+    ty1 = tile_of(r.y1 - 1, h);
+    return true;
+}
+
+// Whether every pixel primitive p can touch is in a masked tile: then it changes nothing outside the region
+static bool fits(const double p[3][2], int shape) {
+    int tx0, ty0, tx1, ty1;
+    if (!footprint(p, shape, tx0, ty0, tx1, ty1)) return true;
+    for (int ty = ty0; ty <= ty1; ty++)
+        for (int tx = tx0; tx <= tx1; tx++)
+            if (!masked[ty][tx]) return false;
+    return true;
+}
+
+// Whether point q is in a masked tile
+static bool masked_at(const double q[2]) {
+    int x = std::min((int) input.width - 1, std::max(0, (int) (q[0] * input.width)));
+    int y = std::min((int) input.height - 1, std::max(0, (int) (q[1] * input.height)));
+    return masked[tile_of(y, input.height)][tile_of(x, input.width)];
+}
+
+// Whether primitive p touches a masked tile
+static bool touches(const double p[3][2], int shape) {
+    int tx0, ty0, tx1, ty1;
+    if (!footprint(p, shape, tx0, ty0, tx1, ty1)) return false;
+    for (int ty = ty0; ty <= ty1; ty++)
+        for (int tx = tx0; tx <= tx1; tx++)
+            if (masked[ty][tx]) return true;
+    return false;
+}
+
+bool roi_start(const char *mask_file, const Chromosome &base) {
+    ImageReader mask;
+    if (!mask.LoadBmpFile(mask_file)) {
+        fprintf(stderr, "Cannot read %s\n", mask_file);
+        return false;
+    }
+    long w = mask.width, h = mask.height;
+    int count = 0;
+    for (int ty = 0; ty < ROI_TILES; ty++) {
+        for (int tx = 0; tx < ROI_TILES; tx++) {
+            bool in = false;
+            for (long y = ty * h / ROI_TILES; y < (ty + 1) * h / ROI_TILES && !in; y++)
+                for (long x = tx * w / ROI_TILES; x < (tx + 1) * w / ROI_TILES && !in; x++)
+                    for (int k = 0; k < mask.channels; k++)
+                        in |= mask.pixel[(y * w + x) * mask.channels + k] > ROI_THRESHOLD;
+            masked[ty][tx] = in;
+            if (!in) continue;
+            count++;
+            box[0] = count == 1 ? tx : std::min(box[0], tx);
+            box[1] = count == 1 ? ty : std::min(box[1], ty);
+            box[2] = count == 1 ? tx + 1 : std::max(box[2], tx + 1);
+            box[3] = count == 1 ? ty + 1 : std::max(box[3], ty + 1);
+        }
+    }
+    for (int axis = 0; axis < 2; axis++) {
+        lo[axis] = (double) box[axis] / ROI_TILES;
+        hi[axis] = (double) box[axis + 2] / ROI_TILES;
+    }
+    mask.Reset();
+    if (!count) {
+        fprintf(stderr, "The mask %s selects nothing\n", mask_file);
+        return false;
+    }
+
+    // A triangle is live if it touches a masked tile and all of it is in masked tiles: one reaching out of them is
+    // frozen, since moving it would change the image outside the region
+    int n_live = 0;
+    for (int t = 0; t < params.triangles; t++) {
+        live[t] = touches(base.point[t], base.shape[t]) && fits(base.point[t], base.shape[t]);
+        n_live += live[t];
+    }
+    printf("Region: %d of %d tiles (box of %dx%d), %d of %d triangles evolve\n", count, ROI_TILES * ROI_TILES,
+           box[2] - box[0], box[3] - box[1], n_live, params.triangles);
+    if (!n_live) {
+        fprintf(stderr, "No triangle of the genome lies inside the region of %s, try a larger mask\n", mask_file);
+        return false;
+    }
+    genome = &base;
+    return true;
+}
+
+void roi_layout() {
+    if (!genome) return;
+    int w = input.width, h = input.height;
+    roi_count = 0;
+    for (int ty = 0; ty < ROI_TILES; ty++)
+        for (int tx = 0; tx < ROI_TILES; tx++) {
+            if (!masked[ty][tx] || (tx && masked[ty][tx - 1])) continue;
+            int end = tx;
+            while (end < ROI_TILES && masked[ty][end]) end++;
+            Rect r = {tx * w / ROI_TILES, ty * h / ROI_TILES, end * w / ROI_TILES, (ty + 1) * h / ROI_TILES};
+            if (!r.empty()) tiles[roi_count++] = r;
+        }
+    roi_tiles = tiles;
+
+    long size = (long) w * h * channels;
+    if (size > frozen_size) {
+        free(frozen);
+        frozen = (unsigned char *) malloc(size);
+        frozen_size = size;
+    }
+    Rect all = {0, 0, w, h};
+    render_rect(genome->point, genome->shape, genome->color, params.triangles, frozen, w, h, all);
+}
+
+void roi_prepare(Chromosome &c) {
+    if (genome) memcpy(c.window, frozen, (size_t) input.width * input.height * channels);
+}
+
+// Shrinks primitive p around its first point until it fits in the masked tiles, false if it never does
+static bool shrink(double (*p)[2], int shape) {
+    for (int i = 0; i < 64 && !fits(p, shape); i++)
+        for (int k = 1; k < V; k++)
+            for (int axis = 0; axis < 2; axis++) p[k][axis] = (p[0][axis] + p[k][axis]) / 2;
+    return fits(p, shape);
+}
+
+// Moves primitive p to the centre of the masked tile nearest to its first point
+static void recentre(double (*p)[2]) {
+    double best = INFINITY, to[2] = {p[0][0], p[0][1]};
+    for (int ty = 0; ty < ROI_TILES; ty++)
+        for (int tx = 0; tx < ROI_TILES; tx++) {
+            double x = (tx + 0.5) / ROI_TILES, y = (ty + 0.5) / ROI_TILES;
+            double d = (x - p[0][0]) * (x - p[0][0]) + (y - p[0][1]) * (y - p[0][1]);
+            if (masked[ty][tx] && d < best) {
+                best = d;
+                to[0] = x;
+                to[1] = y;
+            }
+        }
+    double dx = to[0] - p[0][0], dy = to[1] - p[0][1];
+    for (int k = 0; k < V; k++) {
+        p[k][0] = std::min(1.0, std::max(0.0, p[k][0] + dx));
+        p[k][1] = std::min(1.0, std::max(0.0, p[k][1] + dy));
+    }
+}
+
+void roi_constrain(Chromosome &c) {
+    if (!genome) return;
+    for (int t = 0; t < params.triangles; t++) {
+        if (live[t]) {
+            double (*p)[2] = c.point[t];
+            for (int k = 0; k < V; k++)
+                for (int axis = 0; axis < 2; axis++) {
+                    double &v = p[k][axis];
+                    if (v < lo[axis] || v > hi[axis]) v = lo[axis] + v * (hi[axis] - lo[axis]);
+                }
+            if (fits(p, c.shape[t])) continue;
+
+            // The box holds unmasked tiles too: move the primitive into the nearest masked tile if its first point
+            // is out of them, then shrink it around that point, as a triangle if it has to. Failing that (tiles of
+            // less than a pixel at this resolution), it goes back to what it is in the genome
+            if (!masked_at(p[0])) recentre(p);
+            if (shrink(p, c.shape[t])) continue;
+            c.shape[t] = SHAPE_TRIANGLE;
+            if (shrink(p, c.shape[t])) continue;
+        }
+        memcpy(c.point[t], genome->point[t], sizeof(c.point[t]));
+        memcpy(c.color[t], genome->color[t], sizeof(c.color[t]));
+        c.shape[t] = genome->shape[t];
+    }
+}
+
+long roi_mismatch(const Chromosome &c) {
+    if (!genome) return 0;
+    int w = input.width, h = input.height;
+    unsigned char *full = new unsigned char[(size_t) w * h * channels];
+    Rect all = {0, 0, w, h};
+    render_rect(c.point, c.shape, c.color, params.triangles, full, w, h, all);
+    long differ = 0;
+    for (long i = 0; i < (long) w * h; i++)
+        differ += memcmp(full + i * channels, c.window + i * channels, channels) != 0;
+    delete[] full;
+    return differ;
+}
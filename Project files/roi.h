@@ -0,0 +1,36 @@
+/*
+ * Region of interest re-evolution
+ * Redoes part of an image: given an existing genome and a mask, only the triangles overlapping the masked part evolve,
+ * the others stay frozen as they are in the genome. The mask is reduced to tiles, which make the region. A triangle is
+ * live if every pixel it can touch is in a masked tile, and stays so whatever it mutates into (moved back in, shrunk),
+ * so nothing outside the masked tiles ever changes. fitness only renders and scores the masked tiles (see roi_tiles
+ * in chromosome.h), and the rest of every window keeps the render of the genome, made once per resolution. A
+ * generation then costs in proportion to the area of the region, not of the image, nor of its bounding box.
+ */
+
+#ifndef ROI_H
+#define ROI_H
+
+#include "chromosome.h"
+
+#define ROI_TILES 32       // The mask is reduced to ROI_TILES x ROI_TILES tiles of the canvas
+#define ROI_THRESHOLD 127  // A tile is in the region if any of its mask pixels is brighter than this
+
+// Reads the mask and splits the triangles of genome (kept by reference) into live and frozen ones
+// Returns false if the mask cannot be read or selects nothing
+bool roi_start(const char *mask_file, const Chromosome &genome);
+
+// Lays the region out at the current resolution of input, to call again after any change of resolution
+void roi_layout();
+
+// Gives c.window the frozen part, the render of the genome outside the region
+void roi_prepare(Chromosome &c);
+
+// Puts the frozen triangles of c back, and brings its live triangles that left the region back in, at the current
+// resolution (pixels are matched to tiles exactly, so this is to call again after a change of resolution)
+void roi_constrain(Chromosome &c);
+
+// Pixels where a full render of c differs from c.window, 0 unless the region leaked (a check of the output)
+long roi_mismatch(const Chromosome &c);
+
+#endif // ROI_H
@@ -0,0 +1,328 @@
+/*
+ * Shared-memory frame publishing, see viewer.h
+ * The object is a ViewerHeader followed by VIEWER_SLOTS pixel buffers of capacity bytes each
+ */
+
+#include "viewer.h"
+#include "chromosome.h"
+#include "anytime.h"
+#include "check.h"
+#include <GL/glut.h>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define VIEWER_MAGIC 0x57564147 // "GAVW"
+#define VIEWER_RETRIES 100      // Attempts to copy a frame before giving up
+#define VIEWER_CHECK_SIDE 64    // Frames of check_viewer() are squares of this many pixels
+#define VIEWER_CHECK_READS 2000 // Frames check_viewer() reads while its writer goes around the ring
+
+static_assert(std::atomic<unsigned>::is_always_lock_free, "seqlocks in shared memory need lock-free atomics");
+
+// One slot of the ring, seq is odd while the run writes it
+struct ViewerFrame {
+    std::atomic<unsigned> seq;
+    int epoch, width, height, channels;
+    ll fit;
+    double seconds; // since the run started
+};
+
+struct ViewerHeader {
+    unsigned int magic;
+    int slots;
+    long capacity; // bytes of every pixel buffer
+    std::atomic<unsigned long long> published; // frames published so far, the newest is in slot (published - 1) % slots
+    ViewerFrame frame[VIEWER_SLOTS];
+};
+
+// Run side
+static char shared_name[256];
+static ViewerHeader *shared = nullptr;
+static size_t shared_size = 0;
+static double last_publish = 0, share_start = 0;
+static ll last_fit = -1;
+
+static size_t object_size(long capacity) {
+    return sizeof(ViewerHeader) + (size_t) VIEWER_SLOTS * capacity;
+}
+
+// Pixel buffer of slot i
+static unsigned char *slot_pixels(const ViewerHeader *h, int i) {
+    return (unsigned char *) h + sizeof(ViewerHeader) + (size_t) i * h->capacity;
+}
+
+// POSIX names are "/name", a leading slash is added when missing
+static void object_name(const char *name, char *out, size_t size) {
+    snprintf(out, size, "%s%s", name[0] == '/' ? "" : "/", name);
+}
+
+bool viewer_share(const char *name, long capacity) {
+    object_name(name, shared_name, sizeof(shared_name));
+    shared_size = object_size(capacity);
+    int fd = shm_open(shared_name, O_CREAT | O_RDWR, 0644);
+    if (fd < 0 || ftruncate(fd, shared_size) != 0) {
+        perror(shared_name);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    void *p = mmap(nullptr, shared_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror(shared_name);
+        return false;
+    }
+
+    // Left over by an earlier run or not, the object starts empty; the magic goes last
+    shared = (ViewerHeader *) p;
+    memset(p, 0, sizeof(ViewerHeader));
+    shared->slots = VIEWER_SLOTS;
+    shared->capacity = capacity;
+    std::atomic_thread_fence(std::memory_order_release);
+    shared->magic = VIEWER_MAGIC;
+    share_start = now_seconds();
+    last_publish = 0;
+    last_fit = -1;
+    printf("Sharing the best frame as %s (%zu bytes)\n", shared_name, shared_size);
+    return true;
+}
+
+void viewer_publish(int epoch, ll fit, const unsigned char *pixel, int w, int h) {
+    if (!shared || fit == last_fit) return;
+    double now = now_seconds();
+    if (now - last_publish < VIEWER_INTERVAL_MS / 1000.0) return;
+    long bytes = (long) w * h * channels;
+    if (bytes > shared->capacity) return;
+    last_publish = now;
+    last_fit = fit;
+
+    unsigned long long n = shared->published.load(std::memory_order_relaxed);
+    int i = (int) (n % VIEWER_SLOTS);
+    ViewerFrame &f = shared->frame[i];
+    unsigned s = f.seq.load(std::memory_order_relaxed);
+    f.seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    f.epoch = epoch;
+    f.width = w;
+    f.height = h;
+    f.channels = channels;
+    f.fit = fit;
+    f.seconds = now - share_start;
+    memcpy(slot_pixels(shared, i), pixel, bytes);
+    f.seq.store(s + 2, std::memory_order_release);
+    shared->published.store(n + 1, std::memory_order_release);
+}
+
+void viewer_unshare() {
+    if (!shared) return;
+    munmap(shared, shared_size);
+    shm_unlink(shared_name);
+    shared = nullptr;
+}
+
+// Viewer side: the mapping (read-only) and the last frame copied out of it
+static const ViewerHeader *view = nullptr;
+static size_t view_size = 0;
+static ViewerFrame seen;
+static unsigned char *seen_pixels = nullptr;
+static unsigned char *copy_pixels = nullptr; // a frame being copied, it only becomes seen once it is known whole
+static unsigned long long seen_count = 0;
+
+static void view_close() {
+    if (view) munmap((void *) view, view_size);
+    view = nullptr;
+    delete[] seen_pixels;
+    delete[] copy_pixels;
+    seen_pixels = copy_pixels = nullptr;
+    seen_count = 0;
+}
+
+static bool view_open(const char *name) {
+    char path[256];
+    object_name(name, path, sizeof(path));
+    int fd = shm_open(path, O_RDONLY, 0);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(ViewerHeader)) {
+        fprintf(stderr, "Nothing is shared as %s\n", path);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror(path);
+        return false;
+    }
+    view = (const ViewerHeader *) p;
+    view_size = st.st_size;
+    if (view->magic != VIEWER_MAGIC || view->slots != VIEWER_SLOTS || view->capacity <= 0 ||
+        (size_t) st.st_size < object_size(view->capacity)) {
+        fprintf(stderr, "%s is not a frame ring of this version\n", path);
+        view_close();
+        return false;
+    }
+    seen_pixels = new unsigned char[view->capacity];
+    copy_pixels = new unsigned char[view->capacity];
+    return true;
+}
+
+// Copies the newest frame into seen if there is one it did not copy yet, returns whether it did
+static bool view_fetch() {
+    for (int attempt = 0; attempt < VIEWER_RETRIES; attempt++) {
+        unsigned long long n = view->published.load(std::memory_order_acquire);
+        if (n == 0 || n == seen_count) return false;
+        int i = (int) ((n - 1) % VIEWER_SLOTS);
+        const ViewerFrame &f = view->frame[i];
+        unsigned s = f.seq.load(std::memory_order_acquire);
+        if (s & 1) continue;
+        int w = f.width, h = f.height, c = f.channels, epoch = f.epoch;
+        ll fit = f.fit;
+        double seconds = f.seconds;
+        long bytes = (long) w * h * c;
+        bool sane = w > 0 && h > 0 && (c == 1 || c == 3) && bytes <= view->capacity;
+        if (sane) memcpy(copy_pixels, slot_pixels(view, i), bytes);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (f.seq.load(std::memory_order_relaxed) != s || !sane) continue;
+
+        // The copy is whole: it replaces the frame seen so far, which is left as it was by the failed attempts
+        std::swap(seen_pixels, copy_pixels);
+        seen.epoch = epoch;
+        seen.fit = fit;
+        seen.seconds = seconds;
+        seen.width = w;
+        seen.height = h;
+        seen.channels = c;
+        seen_count = n;
+        return true;
+    }
+    return false;
+}
+
+static void view_display() {
+    glClear(GL_COLOR_BUFFER_BIT);
+    if (seen_count) {
+        glRasterPos2d(0, 0);
+        glPixelZoom((float) glutGet(GLUT_WINDOW_WIDTH) / seen.width, (float) glutGet(GLUT_WINDOW_HEIGHT) / seen.height);
+        glDrawPixels(seen.width, seen.height, seen.channels == 1 ? GL_LUMINANCE : GL_RGB, GL_UNSIGNED_BYTE,
+                     seen_pixels);
+    }
+    glutSwapBuffers();
+}
+
+static void view_idle() {
+    if (view_fetch()) {
+        char title[128];
+        snprintf(title, sizeof(title), "GeneticArt viewer: generation %d, fitness %lld, %.1fs", seen.epoch, seen.fit,
+                 seen.seconds);
+        glutSetWindowTitle(title);
+        glutPostRedisplay();
+    }
+    usleep(VIEWER_POLL_MS * 1000);
+}
+
+int run_viewer(const char *name, int *argc, char **argv) {
+    if (!view_open(name)) return 1;
+    glutInit(argc, argv);
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
+    glutInitWindowSize(SCALE, SCALE);
+    glutCreateWindow("GeneticArt viewer");
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluOrtho2D(0.0, 1.0, 0.0, 1.0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glutDisplayFunc(view_display);
+    glutIdleFunc(view_idle);
+    glutMainLoop();
+    return 0;
+}
+
+int viewer_snapshot(const char *name, const char *output) {
+    if (!view_open(name)) return 1;
+    if (!view_fetch()) {
+        fprintf(stderr, "No frame was published yet\n");
+        return 1;
+    }
+    if (!ImageReader::WriteBmpFile(output, seen_pixels, seen.width, seen.height, seen.channels)) return 1;
+    printf("Generation %d, fitness %lld (%.1fs into the run), %dx%d written to %s\n", seen.epoch, seen.fit,
+           seen.seconds, seen.width, seen.height, output);
+    return 0;
+}
+
+// Publishes a frame of check_viewer() at once: every byte of it is the epoch, so that a torn copy shows
+static void check_publish(int epoch, unsigned char *pixels) {
+    memset(pixels, epoch & 0xff, (size_t) VIEWER_CHECK_SIDE * VIEWER_CHECK_SIDE * channels);
+    last_publish = 0;
+    viewer_publish(epoch, epoch + 1, pixels, VIEWER_CHECK_SIDE, VIEWER_CHECK_SIDE);
+}
+
+// Whether the frame seen is a whole one of check_publish()
+static bool seen_whole() {
+    long bytes = (long) seen.width * seen.height * seen.channels;
+    for (long i = 0; i < bytes; i++)
+        if (seen_pixels[i] != (seen.epoch & 0xff)) return false;
+    return bytes > 0;
+}
+
+// Mappings of the shared-memory object path in this process
+static int mappings(const char *path) {
+    FILE *f = fopen("/proc/self/maps", "r");
+    char line[512];
+    int n = 0;
+    while (f && fgets(line, sizeof(line), f)) n += strstr(line, path) != nullptr;
+    if (f) fclose(f);
+    return n;
+}
+
+void check_viewer() {
+    char name[64];
+    snprintf(name, sizeof(name), "/geneticart-check-%d", (int) getpid());
+    long capacity = (long) VIEWER_CHECK_SIDE * VIEWER_CHECK_SIDE * channels;
+    if (!check("frame ring can be shared", viewer_share(name, capacity))) return;
+    unsigned char *pixels = new unsigned char[capacity];
+
+    check_publish(1, pixels);
+    bool ok = view_open(name) && view_fetch() && seen.epoch == 1 && seen_whole() && !view_fetch();
+    check("frame ring gives a reader the newest frame, once", ok);
+
+    // A frame the run is still writing, or one that cannot be read, is skipped and the reader keeps the one it has
+    check_publish(2, pixels);
+    ViewerFrame &f = shared->frame[(shared->published - 1) % VIEWER_SLOTS];
+    f.seq++;
+    ok = !view_fetch() && seen.epoch == 1 && seen_whole();
+    f.seq++;
+    f.channels = 2;
+    ok &= !view_fetch() && seen.epoch == 1 && seen_whole();
+    f.channels = channels;
+    ok &= view_fetch() && seen.epoch == 2 && seen_whole();
+    check("frame ring skips a frame it cannot read, keeping the last one", ok);
+
+    // A writer goes around the ring while frames are read: every one read is whole, failed reads change nothing
+    std::atomic<bool> done(false);
+    std::thread writer([&] {
+        for (int e = 3; !done.load(); e++) check_publish(e, pixels);
+    });
+    ok = true;
+    for (int i = 0; i < VIEWER_CHECK_READS && ok; i++) {
+        seen_count = 0; // reads the newest frame again, even if it already has it
+        view_fetch();
+        ok = seen_whole();
+    }
+    done = true;
+    writer.join();
+    check("frame ring is never read torn while it is overwritten", ok);
+
+    // Something else under the name is refused, and not left mapped
+    view_close();
+    shared->magic = 0;
+    int before = mappings(name);
+    ok = !view_open(name) && !view && mappings(name) == before;
+    check("frame ring of another version is refused and unmapped", ok);
+
+    viewer_unshare();
+    delete[] pixels;
+}
@@ -0,0 +1,35 @@
+/*
+ * Shared-memory frame publishing, for watching a run from other processes (headless servers have no GLUT window)
+ * With --share NAME, the run copies the render of its best chromosome (at most every VIEWER_INTERVAL_MS, when it
+ * improved) into a POSIX shared-memory object: a ring of VIEWER_SLOTS frames, each guarded by a seqlock. The run
+ * never waits for viewers, and viewers map the object read-only, so any number of them can come and go.
+ * A reader copies the newest frame and retries if its sequence number changed meanwhile (the run would have to go
+ * around the whole ring during one copy for that to happen).
+ * --viewer NAME shows the frames in a window, --snapshot NAME writes the newest one to --output and exits.
+ */
+
+#ifndef VIEWER_H
+#define VIEWER_H
+
+#include "raster.h"
+
+#define VIEWER_SLOTS 4          // Frames in the ring
+#define VIEWER_INTERVAL_MS 100  // Shortest time between two published frames
+#define VIEWER_POLL_MS 50       // How often the viewer window looks for a new frame
+
+// Creates (or takes over) the shared-memory object name, sized for frames of up to capacity bytes
+bool viewer_share(const char *name, long capacity);
+
+// Publishes a w x h frame of the run (rows bottom-up, channels bytes per pixel) if it is time to
+void viewer_publish(int epoch, ll fit, const unsigned char *pixel, int w, int h);
+
+// Removes the shared-memory object, viewers still mapping it keep the last frames; safe to call more than once
+void viewer_unshare();
+
+// Shows the frames published to name in a GLUT window until it is closed
+int run_viewer(const char *name, int *argc, char **argv);
+
+// Writes the newest frame published to name to output
+int viewer_snapshot(const char *name, const char *output);
+
+#endif // VIEWER_H